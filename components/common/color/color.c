@@ -0,0 +1,419 @@
+#include "color.h"
+
+// Share of a sector's leading channel in the saturated part of the color,
+// (1 + cos(h) / cos(60 - h)) / 3 in Q15, for each degree h of a 120 degree
+// sector. The trailing channel gets the rest. Entries are 32 bit wide so that
+// reading them from flash doesn't go through the unaligned load handler.
+static const uint32_t hue_share[120] = {
+    32768, 32127, 31522, 30950, 30408, 29893, 29404, 28937, 28491, 28065,
+    27657, 27266, 26890, 26528, 26179, 25843, 25519, 25205, 24901, 24607,
+    24321, 24044, 23774, 23512, 23257, 23007, 22764, 22527, 22295, 22068,
+    21845, 21627, 21414, 21204, 20998, 20795, 20596, 20399, 20206, 20015,
+    19827, 19641, 19458, 19276, 19096, 18919, 18742, 18568, 18395, 18223,
+    18052, 17882, 17713, 17545, 17378, 17212, 17045, 16880, 16714, 16549,
+    16384, 16219, 16054, 15888, 15723, 15556, 15390, 15223, 15055, 14886,
+    14716, 14545, 14373, 14200, 14026, 13849, 13672, 13492, 13310, 13127,
+    12941, 12753, 12562, 12369, 12172, 11973, 11770, 11564, 11354, 11141,
+    10923, 10700, 10473, 10241, 10004, 9761, 9511, 9256, 8994, 8724,
+    8447, 8161, 7867, 7563, 7249, 6925, 6589, 6240, 5878, 5502,
+    5111, 4703, 4277, 3831, 3364, 2875, 2360, 1818, 1246, 641,
+};
+
+// Black body color in linear light for every COLOR_MIRED_STEP from
+// COLOR_MIRED_MIN to COLOR_MIRED_MAX, Q15 with the brightest channel at
+// COLOR_ONE. Taken from Tanner Helland's fit of the sRGB black body
+// colors and converted from sRGB to linear.
+static const uint32_t blackbody[COLOR_MIRED_STEPS][3] = {
+    { 28106, 28474, 32768 },   // 7143 K
+    { 32768, 31230, 32768 },   // 6667 K
+    { 32768, 31385, 29533 },   // 6250 K
+    { 32768, 29693, 26842 },   // 5882 K
+    { 32768, 28148, 24412 },   // 5556 K
+    { 32768, 26731, 22210 },   // 5263 K
+    { 32768, 25425, 20209 },   // 5000 K
+    { 32768, 24219, 18385 },   // 4762 K
+    { 32768, 23100, 16719 },   // 4545 K
+    { 32768, 22060, 15193 },   // 4348 K
+    { 32768, 21090, 13794 },   // 4167 K
+    { 32768, 20184, 12509 },   // 4000 K
+    { 32768, 19335, 11328 },   // 3846 K
+    { 32768, 18538, 10241 },   // 3704 K
+    { 32768, 17789,  9240 },   // 3571 K
+    { 32768, 17083,  8319 },   // 3448 K
+    { 32768, 16416,  7470 },   // 3333 K
+    { 32768, 15786,  6689 },   // 3226 K
+    { 32768, 15190,  5970 },   // 3125 K
+    { 32768, 14625,  5309 },   // 3030 K
+    { 32768, 14088,  4702 },   // 2941 K
+    { 32768, 13579,  4145 },   // 2857 K
+    { 32768, 13094,  3635 },   // 2778 K
+    { 32768, 12632,  3170 },   // 2703 K
+    { 32768, 12192,  2745 },   // 2632 K
+    { 32768, 11772,  2360 },   // 2564 K
+    { 32768, 11371,  2011 },   // 2500 K
+    { 32768, 10988,  1697 },   // 2439 K
+    { 32768, 10621,  1415 },   // 2381 K
+    { 32768, 10270,  1164 },   // 2326 K
+    { 32768,  9933,   943 },   // 2273 K
+    { 32768,  9610,   749 },   // 2222 K
+    { 32768,  9301,   581 },   // 2174 K
+    { 32768,  9004,   438 },   // 2128 K
+    { 32768,  8718,   318 },   // 2083 K
+    { 32768,  8444,   220 },   // 2041 K
+    { 32768,  8180,   143 },   // 2000 K
+};
+
+// CIE 1931 lightness (L* = level * 100 / 255) to relative luminance,
+// scaled to max and rounded, with every non-zero level lit:
+//   Y = L* / 903.3                  for L* <= 8
+//   Y = ((L* + 16) / 116) ^ 3       otherwise
+#define CIE_LINEAR(l, max) \
+    (((uint64_t)(l) * 1000 * (max) + 255 * 9033 / 2) / (255ULL * 9033))
+#define CIE_CUBE(l) \
+    ((uint64_t)((l) * 100 + 16 * 255) * ((l) * 100 + 16 * 255) * ((l) * 100 + 16 * 255))
+#define CIE_CUBIC(l, max) \
+    ((CIE_CUBE(l) * (max) + 29580ULL * 29580 * 29580 / 2) / (29580ULL * 29580 * 29580))
+#define CIE_LIT(y) ((y) ? (y) : 1)
+#define CIE(l, max) \
+    ((l) == 0 ? 0 : CIE_LIT((l) * 100 <= 8 * 255 ? CIE_LINEAR(l, max) : CIE_CUBIC(l, max)))
+
+#define CIE_4(l, max) CIE(l, max), CIE(l + 1, max), CIE(l + 2, max), CIE(l + 3, max)
+#define CIE_16(l, max) CIE_4(l, max), CIE_4(l + 4, max), CIE_4(l + 8, max), CIE_4(l + 12, max)
+#define CIE_64(l, max) CIE_16(l, max), CIE_16(l + 16, max), CIE_16(l + 32, max), CIE_16(l + 48, max)
+#define CIE_256(max) CIE_64(0, max), CIE_64(64, max), CIE_64(128, max), CIE_64(192, max)
+
+static const uint32_t gamma8[256] = { CIE_256(0xff) };
+static const uint32_t gamma12[256] = { CIE_256(0xfff) };
+static const uint32_t gamma16[256] = { CIE_256(0xffff) };
+
+
+uint16_t color_intensity_linear(uint8_t percent) {
+    if (percent >= 100)
+        return COLOR_ONE;
+
+    // percent * 327.68
+    return (percent * 20972) >> 6;
+}
+
+
+uint16_t color_intensity_perceptual(uint8_t percent) {
+    // 0xffff -> COLOR_ONE
+    return (color_gamma16(color_level(percent)) + 1) >> 1;
+}
+
+
+uint8_t color_level(uint8_t percent) {
+    if (percent >= 100)
+        return 255;
+
+    // percent * 2.55, rounded
+    return (percent * 167117 + 32768) >> 16;
+}
+
+
+uint8_t color_gamma8(uint8_t level) {
+    return gamma8[level];
+}
+
+
+uint16_t color_gamma12(uint8_t level) {
+    return gamma12[level];
+}
+
+
+uint16_t color_gamma16(uint8_t level) {
+    return gamma16[level];
+}
+
+
+// Fraction bits below Q15 that the HSI conversion keeps between its steps,
+// so that truncating the intermediate values doesn't show at 16 bit scales.
+#define HSI_EXTRA_BITS 8
+#define HSI_SHIFT (15 + HSI_EXTRA_BITS)
+
+
+// Splits a color into its saturated part, which is shared between the two
+// channels of the hue's sector, and its desaturated part.
+//
+// Channels are returned as Q23 fractions (HSI_SHIFT) in sector order:
+// leading, trailing and the channel that only gets the desaturated part.
+static uint8_t hsi_split(uint16_t hue, uint8_t saturation, uint16_t intensity,
+                         uint32_t *lead, uint32_t *trail, uint32_t *gray) {
+    if (saturation > 100)
+        saturation = 100;
+    if (intensity > COLOR_ONE)
+        intensity = COLOR_ONE;
+
+    hue %= 360;
+    uint8_t sector = 0;
+    if (hue >= 240) {
+        sector = 2;
+        hue -= 240;
+    } else if (hue >= 120) {
+        sector = 1;
+        hue -= 120;
+    }
+
+    // saturation * 83886.08, the percentage as a Q23 fraction
+    uint32_t share = (saturation >= 100) ? 1 << HSI_SHIFT : (saturation * 5368709 + 32) >> 6;
+    uint32_t chroma = ((uint64_t)intensity * share) >> 15;
+
+    *lead = ((uint64_t)chroma * hue_share[hue] + (1 << 14)) >> 15;
+    *trail = chroma - *lead;
+    *gray = ((uint32_t)intensity << HSI_EXTRA_BITS) - chroma;
+
+    return sector;
+}
+
+
+static inline uint32_t hsi_scale(uint32_t value, uint16_t scale) {
+    return ((uint64_t)value * scale) >> HSI_SHIFT;
+}
+
+
+static void hsi_assign(uint8_t sector, uint32_t lead, uint32_t trail, uint32_t rest,
+                       uint16_t scale, color_rgbw_t *rgb) {
+    lead = hsi_scale(lead, scale);
+    trail = hsi_scale(trail, scale);
+    rest = hsi_scale(rest, scale);
+
+    switch (sector) {
+        case 0:
+            rgb->red = lead;
+            rgb->green = trail;
+            rgb->blue = rest;
+            break;
+        case 1:
+            rgb->green = lead;
+            rgb->blue = trail;
+            rgb->red = rest;
+            break;
+        default:
+            rgb->blue = lead;
+            rgb->red = trail;
+            rgb->green = rest;
+    }
+}
+
+
+void color_hsi2rgb(uint16_t hue, uint8_t saturation, uint16_t intensity,
+                   uint16_t scale, color_rgbw_t *rgb) {
+    uint32_t lead, trail, gray;
+    uint8_t sector = hsi_split(hue, saturation, intensity, &lead, &trail, &gray);
+
+    // Every channel gets an equal part of the desaturated color
+    gray /= 3;
+
+    hsi_assign(sector, lead + gray, trail + gray, gray, scale, rgb);
+    rgb->white = 0;
+}
+
+
+void color_hsi2rgbw(uint16_t hue, uint8_t saturation, uint16_t intensity,
+                    uint16_t scale, color_rgbw_t *rgbw) {
+    uint32_t lead, trail, gray;
+    uint8_t sector = hsi_split(hue, saturation, intensity, &lead, &trail, &gray);
+
+    hsi_assign(sector, lead, trail, 0, scale, rgbw);
+    rgbw->white = hsi_scale(gray, scale);
+}
+
+
+// Bit offsets of the leading, trailing and remaining channel of each hue
+// sector in a packed pixel word.
+static const uint32_t sector_shift[3][3] = {
+    { 16, 8, 0 },   // red, green, blue
+    { 8, 0, 16 },   // green, blue, red
+    { 0, 16, 8 },   // blue, red, green
+};
+
+
+static inline uint32_t pixel_scale(uint32_t pixel, uint32_t level) {
+    // Blue/red and green/white are scaled in pairs, each channel has
+    // 8 bits of headroom in its 16 bit lane. Rounding is done per lane.
+    uint32_t br = (((pixel & 0x00ff00ff) * level + 0x00800080) >> 8) & 0x00ff00ff;
+    uint32_t gw = (((pixel >> 8) & 0x00ff00ff) * level + 0x00800080) & 0xff00ff00;
+    return br | gw;
+}
+
+
+void color_hsi2pixels(const color_hsi_t *colors, uint32_t *pixels, size_t count) {
+    // Everything that only depends on saturation is kept across pixels,
+    // effects usually vary just hue or intensity along the strip.
+    int saturation = -1;
+    uint32_t chroma = 0, gray = 0, gray8 = 0;
+
+    for (size_t n = 0; n < count; n++) {
+        const color_hsi_t *color = &colors[n];
+
+        if (color->saturation != saturation) {
+            saturation = color->saturation;
+            chroma = color_intensity_linear(saturation);
+            gray = ((COLOR_ONE - chroma) * 21846) >> 16;
+            gray8 = (gray * 255) >> 15;
+        }
+
+        uint32_t hue = color->hue;
+        while (hue >= 360)
+            hue -= 360;
+
+        uint8_t sector = 0;
+        if (hue >= 240) {
+            sector = 2;
+            hue -= 240;
+        } else if (hue >= 120) {
+            sector = 1;
+            hue -= 120;
+        }
+
+        // Full intensity color first, intensity is applied to the packed word
+        uint32_t lead = (chroma * hue_share[hue]) >> 15;
+        uint32_t trail = chroma - lead;
+
+        const uint32_t *shift = sector_shift[sector];
+        uint32_t pixel = (((lead + gray) * 255) >> 15) << shift[0]
+                       | (((trail + gray) * 255) >> 15) << shift[1]
+                       | gray8 << shift[2];
+
+        uint32_t intensity = color->intensity;
+        if (intensity >= COLOR_ONE) {
+            pixels[n] = pixel;
+        } else {
+            pixels[n] = pixel_scale(pixel, (intensity + 64) >> 7);
+        }
+    }
+}
+
+
+void color_pixels_scale(uint32_t *pixels, size_t count, uint16_t level) {
+    if (level >= 256)
+        return;
+
+    for (size_t n = 0; n < count; n++)
+        pixels[n] = pixel_scale(pixels[n], level);
+}
+
+
+// Position of a color temperature in the tables, returns the step and
+// sets the Q15 weight of the following one.
+static uint8_t mired_step(uint16_t mired, uint32_t *weight) {
+    if (mired <= COLOR_MIRED_MIN) {
+        *weight = 0;
+        return 0;
+    }
+    if (mired >= COLOR_MIRED_MAX) {
+        *weight = 0;
+        return COLOR_MIRED_STEPS - 1;
+    }
+
+    mired -= COLOR_MIRED_MIN;
+    uint8_t step = mired / COLOR_MIRED_STEP;
+    *weight = (mired - step * COLOR_MIRED_STEP) * COLOR_ONE / COLOR_MIRED_STEP;
+    return step;
+}
+
+
+static inline uint32_t mired_lerp(uint32_t lo, uint32_t hi, uint32_t weight) {
+    return (lo * (COLOR_ONE - weight) + hi * weight) >> 15;
+}
+
+
+static void blackbody_ratio(uint16_t mired, uint32_t *ratio) {
+    uint32_t weight;
+    uint8_t step = mired_step(mired, &weight);
+    uint8_t next = (weight) ? step + 1 : step;
+
+    for (int i = 0; i < 3; i++)
+        ratio[i] = mired_lerp(blackbody[step][i], blackbody[next][i], weight);
+}
+
+
+void color_mired2rgb(uint16_t mired, uint16_t intensity, uint16_t scale,
+                     color_rgbw_t *rgb) {
+    if (intensity > COLOR_ONE)
+        intensity = COLOR_ONE;
+
+    uint32_t ratio[3];
+    blackbody_ratio(mired, ratio);
+
+    uint32_t level = (intensity * (uint32_t)scale) >> 15;
+    rgb->red = (ratio[0] * level) >> 15;
+    rgb->green = (ratio[1] * level) >> 15;
+    rgb->blue = (ratio[2] * level) >> 15;
+    rgb->white = 0;
+}
+
+
+void color_white_init(color_white_t *white, uint16_t white_mired) {
+    uint32_t led[3];
+    blackbody_ratio(white_mired, led);
+
+    for (int step = 0; step < COLOR_MIRED_STEPS; step++) {
+        const uint32_t *target = blackbody[step];
+
+        // Most white that doesn't overshoot any channel, at most COLOR_ONE
+        // as the LED's brightest channel is COLOR_ONE
+        uint32_t share = COLOR_ONE;
+        for (int i = 0; i < 3; i++) {
+            if (led[i] && target[i] * COLOR_ONE / led[i] < share)
+                share = target[i] * COLOR_ONE / led[i];
+        }
+
+        uint32_t mix[4];
+        for (int i = 0; i < 3; i++)
+            mix[i] = target[i] - ((led[i] * share) >> 15);
+        mix[3] = share * 3;
+
+        uint32_t peak = 1;
+        for (int i = 0; i < 4; i++) {
+            if (mix[i] > peak)
+                peak = mix[i];
+        }
+
+        for (int i = 0; i < 4; i++)
+            white->mix[step][i] = (uint64_t)mix[i] * COLOR_ONE / peak;
+    }
+}
+
+
+void color_mired2rgbw(const color_white_t *white, uint16_t mired,
+                      uint16_t intensity, uint16_t scale, color_rgbw_t *rgbw) {
+    if (intensity > COLOR_ONE)
+        intensity = COLOR_ONE;
+
+    uint32_t weight;
+    uint8_t step = mired_step(mired, &weight);
+    const uint16_t *lo = white->mix[step];
+    const uint16_t *hi = white->mix[(weight) ? step + 1 : step];
+
+    uint32_t level = (intensity * (uint32_t)scale) >> 15;
+    rgbw->red = (mired_lerp(lo[0], hi[0], weight) * level) >> 15;
+    rgbw->green = (mired_lerp(lo[1], hi[1], weight) * level) >> 15;
+    rgbw->blue = (mired_lerp(lo[2], hi[2], weight) * level) >> 15;
+    rgbw->white = (mired_lerp(lo[3], hi[3], weight) * level) >> 15;
+}
+
+
+void color_mired2ww(uint16_t mired, uint16_t cold_mired, uint16_t warm_mired,
+                    uint16_t intensity, uint16_t scale,
+                    uint16_t *cold, uint16_t *warm) {
+    if (intensity > COLOR_ONE)
+        intensity = COLOR_ONE;
+
+    uint32_t level = (intensity * (uint32_t)scale) >> 15;
+
+    if (warm_mired <= cold_mired || mired <= cold_mired) {
+        *cold = level;
+        *warm = 0;
+        return;
+    }
+    if (mired >= warm_mired) {
+        *cold = 0;
+        *warm = level;
+        return;
+    }
+
+    // Mixed light moves about linearly in mired between the two LEDs
+    *warm = level * (mired - cold_mired) / (warm_mired - cold_mired);
+    *cold = level - *warm;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+    Integer-only color conversion.
+
+    All fractions are Q15 fixed point values where COLOR_ONE stands for 1.0,
+    so no float math (and no libm) is needed on the ESP8266.
+*/
+#define COLOR_ONE 32768
+
+typedef struct {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t white;
+} color_rgbw_t;
+
+typedef struct {
+    uint16_t hue;           // degrees, 0-359
+    uint8_t saturation;     // percent, 0-100
+    uint16_t intensity;     // Q15, 0-COLOR_ONE
+} color_hsi_t;
+
+/**
+    Rounds HomeKit's float hue (0-360) and percentages (0-100) to the
+    integer arguments of the functions below. Values out of range and NaN
+    are clamped, a plain conversion would truncate them or be undefined.
+*/
+static inline uint16_t color_hue(float hue) {
+    if (!(hue > 0))
+        return 0;
+    if (hue > 360)
+        return 360;
+    return (uint16_t)(hue + 0.5f);
+}
+
+static inline uint8_t color_percent(float percent) {
+    if (!(percent > 0))
+        return 0;
+    if (percent > 100)
+        return 100;
+    return (uint8_t)(percent + 0.5f);
+}
+
+/**
+    Converts a HomeKit brightness percentage (0-100) to a linear Q15 intensity.
+*/
+uint16_t color_intensity_linear(uint8_t percent);
+
+/**
+    Converts a HomeKit brightness percentage (0-100) to a Q15 intensity that
+    looks evenly spaced, using the CIE 1931 lightness curve.
+*/
+uint16_t color_intensity_perceptual(uint8_t percent);
+
+/**
+    Converts a HomeKit brightness percentage (0-100) to an 8 bit lightness
+    level (0-255) for the color_gamma*() tables.
+*/
+uint8_t color_level(uint8_t percent);
+
+/**
+    Lightness to output value lookup following the CIE 1931 lightness curve.
+
+    Tables are generated at compile time and kept in flash, any non-zero level
+    gives a non-zero output. Every light output should go through these rather
+    than scaling brightness linearly.
+
+    @param level Lightness level, 0-255
+    @return Output value for 8, 12 or 16 bit wide channels
+*/
+uint8_t color_gamma8(uint8_t level);
+uint16_t color_gamma12(uint8_t level);
+uint16_t color_gamma16(uint8_t level);
+
+/**
+    Converts HSI color to RGB, see
+    http://blog.saikoled.com/post/44677718712/how-to-convert-from-hsi-to-rgb-white
+
+    @param hue Hue in degrees, wrapped around to 0-359
+    @param saturation Saturation in percent, 0-100
+    @param intensity Q15 intensity, 0-COLOR_ONE
+    @param scale Value of a channel at full intensity (e.g. 255), channels
+                 are within 1 LSB of the exact value up to 0xffff
+    @param rgb Result, white channel is set to 0
+*/
+void color_hsi2rgb(uint16_t hue, uint8_t saturation, uint16_t intensity,
+                   uint16_t scale, color_rgbw_t *rgb);
+
+/**
+    Converts HSI color to RGBW: the desaturated part of the color goes to the
+    white channel and at most two color channels are lit.
+
+    Parameters are the same as for color_hsi2rgb().
+*/
+void color_hsi2rgbw(uint16_t hue, uint8_t saturation, uint16_t intensity,
+                    uint16_t scale, color_rgbw_t *rgbw);
+
+/**
+    Converts a whole frame of HSI colors to 8 bit RGB pixels in one pass.
+
+    Pixels are packed into 32 bit words with blue in the low byte, then green,
+    red and white, which is the layout of ws2812_pixel_t.color, so a
+    ws2812_pixel_t buffer can be passed as &pixels[0].color. White is set to 0.
+    Channels are within 1 LSB of color_hsi2rgb() at scale 255.
+
+    @param colors Colors to convert
+    @param pixels Buffer receiving count packed pixels
+    @param count Number of pixels
+*/
+void color_hsi2pixels(const color_hsi_t *colors, uint32_t *pixels, size_t count);
+
+/**
+    Scales all four channels of packed pixels, two channels per multiply.
+
+    @param pixels Packed pixels (see color_hsi2pixels())
+    @param count Number of pixels
+    @param level Q8 scale factor, 0-256
+*/
+void color_pixels_scale(uint32_t *pixels, size_t count, uint16_t level);
+
+/**
+    Color temperature in mired (1000000 / kelvin), the HomeKit
+    ColorTemperature range. Values outside are clamped.
+*/
+#define COLOR_MIRED_MIN 140     // 7143 K
+#define COLOR_MIRED_MAX 500     // 2000 K
+#define COLOR_MIRED_STEP 10
+#define COLOR_MIRED_STEPS ((COLOR_MIRED_MAX - COLOR_MIRED_MIN) / COLOR_MIRED_STEP + 1)
+
+/**
+    Channel mix of a white LED strip or bulb for every table step of color
+    temperature, computed once by color_white_init() so that setting a
+    temperature is a table lookup.
+*/
+typedef struct {
+    uint16_t mix[COLOR_MIRED_STEPS][4];     // Q15 red, green, blue, white
+} color_white_t;
+
+/**
+    Converts color temperature to RGB, the brightest channel is at intensity.
+
+    Channel ratios come from a flash table of black body colors in linear
+    light, interpolated between COLOR_MIRED_STEP steps.
+
+    @param mired Color temperature, COLOR_MIRED_MIN-COLOR_MIRED_MAX
+    @param intensity Q15 intensity, 0-COLOR_ONE
+    @param scale Value of a channel at full intensity (e.g. 255)
+    @param rgb Result, white channel is set to 0
+*/
+void color_mired2rgb(uint16_t mired, uint16_t intensity, uint16_t scale,
+                     color_rgbw_t *rgb);
+
+/**
+    Prepares color temperature mixing for an RGBW light.
+
+    The white LED gives as much of the light as it can, color channels add
+    the difference between its own temperature and the requested one. Like
+    in color_hsi2rgbw(), white at a level matches all color channels at a
+    third of it.
+
+    @param white_mired Color temperature of the white LED
+*/
+void color_white_init(color_white_t *white, uint16_t white_mired);
+
+/**
+    Converts color temperature to RGBW using a table from color_white_init().
+    The largest channel is at intensity.
+
+    Parameters are the same as for color_mired2rgb().
+*/
+void color_mired2rgbw(const color_white_t *white, uint16_t mired,
+                      uint16_t intensity, uint16_t scale, color_rgbw_t *rgbw);
+
+/**
+    Splits color temperature between cold and warm white LEDs. Temperatures
+    beyond the LEDs' own are clamped to the nearest one.
+
+    @param cold_mired Color temperature of the cold white LED
+    @param warm_mired Color temperature of the warm white LED
+    @param cold Result for the cold channel
+    @param warm Result for the warm channel, cold + warm is at intensity
+*/
+void color_mired2ww(uint16_t mired, uint16_t cold_mired, uint16_t warm_mired,
+                    uint16_t intensity, uint16_t scale,
+                    uint16_t *cold, uint16_t *warm);
@@ -0,0 +1,14 @@
+# Component makefile for color
+
+ifdef component_compile_rules
+    # ESP_OPEN_RTOS
+    INC_DIRS += $(color_ROOT)
+
+    color_SRC_DIR = $(color_ROOT)
+
+    $(eval $(call component_compile_rules,color))
+else
+    # ESP_IDF
+    COMPONENT_SRCDIRS = .
+    COMPONENT_ADD_INCLUDEDIRS = .
+endif
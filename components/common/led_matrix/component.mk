@@ -0,0 +1,14 @@
+# Component makefile for led_matrix
+
+ifdef component_compile_rules
+    # ESP_OPEN_RTOS
+    INC_DIRS += $(led_matrix_ROOT)
+
+    led_matrix_SRC_DIR = $(led_matrix_ROOT)
+
+    $(eval $(call component_compile_rules,led_matrix))
+else
+    # ESP_IDF
+    COMPONENT_SRCDIRS = .
+    COMPONENT_ADD_INCLUDEDIRS = .
+endif
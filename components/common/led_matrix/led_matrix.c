@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include "led_matrix.h"
+
+
+// Index of x,y in a width x height grid, ordered as given
+static uint16_t grid_index(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+                           led_matrix_order_t order, bool serpentine) {
+    if (order == LED_MATRIX_ROWS) {
+        if (serpentine && (y & 1))
+            x = width - 1 - x;
+        return y * width + x;
+    } else {
+        if (serpentine && (x & 1))
+            y = height - 1 - y;
+        return x * height + y;
+    }
+}
+
+
+int led_matrix_init(led_matrix_t *matrix, const led_matrix_layout_t *layout) {
+    uint8_t panels_x = layout->panels_x ? layout->panels_x : 1;
+    uint8_t panels_y = layout->panels_y ? layout->panels_y : 1;
+    uint16_t panel_size = layout->panel_width * layout->panel_height;
+
+    // Physical size, as the panels are mounted
+    uint16_t width = layout->panel_width * panels_x;
+    uint16_t height = layout->panel_height * panels_y;
+
+    bool swap = layout->rotation == LED_MATRIX_ROTATE_90 ||
+                layout->rotation == LED_MATRIX_ROTATE_270;
+    matrix->width = swap ? height : width;
+    matrix->height = swap ? width : height;
+
+    matrix->map = malloc(width * height * sizeof(*matrix->map));
+    if (!matrix->map)
+        return -1;
+
+    for (uint16_t y = 0; y < matrix->height; y++) {
+        for (uint16_t x = 0; x < matrix->width; x++) {
+            uint16_t lx = layout->mirror_x ? matrix->width - 1 - x : x;
+            uint16_t ly = layout->mirror_y ? matrix->height - 1 - y : y;
+
+            uint16_t px, py;
+            switch (layout->rotation) {
+                case LED_MATRIX_ROTATE_90:
+                    px = width - 1 - ly;
+                    py = lx;
+                    break;
+                case LED_MATRIX_ROTATE_180:
+                    px = width - 1 - lx;
+                    py = height - 1 - ly;
+                    break;
+                case LED_MATRIX_ROTATE_270:
+                    px = ly;
+                    py = height - 1 - lx;
+                    break;
+                default:
+                    px = lx;
+                    py = ly;
+            }
+
+            uint16_t panel = grid_index(px / layout->panel_width, py / layout->panel_height,
+                                        panels_x, panels_y,
+                                        layout->panel_order, layout->panel_serpentine);
+            uint16_t pixel = grid_index(px % layout->panel_width, py % layout->panel_height,
+                                        layout->panel_width, layout->panel_height,
+                                        layout->order, layout->serpentine);
+
+            matrix->map[y * matrix->width + x] = panel * panel_size + pixel;
+        }
+    }
+
+    return 0;
+}
+
+
+void led_matrix_done(led_matrix_t *matrix) {
+    free(matrix->map);
+    matrix->map = NULL;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+    Mapping of logical x,y coordinates of an LED matrix to pixel indices
+    on the strip, computed once into a lookup table.
+
+    Coordinates are logical: the matrix as the effect sees it, after
+    rotation and mirroring. Without them, (0, 0) is the pixel the strip
+    starts with, x runs along panel rows and y along panel columns.
+*/
+
+typedef enum {
+    LED_MATRIX_ROWS = 0,        // row after row
+    LED_MATRIX_COLUMNS,         // column after column
+} led_matrix_order_t;
+
+typedef enum {
+    LED_MATRIX_ROTATE_0 = 0,
+    LED_MATRIX_ROTATE_90,       // clockwise, with y growing upwards
+    LED_MATRIX_ROTATE_180,
+    LED_MATRIX_ROTATE_270,
+} led_matrix_rotation_t;
+
+typedef struct {
+    uint16_t panel_width;
+    uint16_t panel_height;
+
+    // Pixels within a panel
+    led_matrix_order_t order;
+    bool serpentine;            // every other row or column runs backwards
+
+    // Panels tiled into the matrix, 0 is the same as 1
+    uint8_t panels_x;
+    uint8_t panels_y;
+    led_matrix_order_t panel_order;
+    bool panel_serpentine;
+
+    led_matrix_rotation_t rotation;
+    bool mirror_x;
+    bool mirror_y;
+} led_matrix_layout_t;
+
+typedef struct {
+    uint16_t width;             // logical size
+    uint16_t height;
+    uint16_t *map;              // pixel index of x,y at map[y*width + x]
+} led_matrix_t;
+
+/**
+    Computes the lookup table for the given layout.
+
+    @return A negative integer if this method fails.
+*/
+int led_matrix_init(led_matrix_t *matrix, const led_matrix_layout_t *layout);
+
+/**
+    Frees the lookup table.
+*/
+void led_matrix_done(led_matrix_t *matrix);
+
+/**
+    Number of pixels in the matrix.
+*/
+static inline uint16_t led_matrix_count(const led_matrix_t *matrix) {
+    return matrix->width * matrix->height;
+}
+
+/**
+    Strip pixel index of logical x,y.
+*/
+static inline uint16_t led_matrix_index(const led_matrix_t *matrix, uint16_t x, uint16_t y) {
+    return matrix->map[y * matrix->width + x];
+}
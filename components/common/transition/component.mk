@@ -0,0 +1,14 @@
+# Component makefile for transition
+
+ifdef component_compile_rules
+    # ESP_OPEN_RTOS
+    INC_DIRS += $(transition_ROOT)
+
+    transition_SRC_DIR = $(transition_ROOT)
+
+    $(eval $(call component_compile_rules,transition))
+else
+    # ESP_IDF
+    COMPONENT_SRCDIRS = .
+    COMPONENT_ADD_INCLUDEDIRS = .
+endif
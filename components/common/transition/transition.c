@@ -0,0 +1,84 @@
+#include <string.h>
+#include "transition.h"
+
+// Progress and eased progress are Q15, 0-TRANSITION_ONE
+#define TRANSITION_ONE 32768
+
+
+void transition_init(transition_t *transition, uint8_t channels,
+                     uint32_t duration_ms, transition_curve_t curve) {
+    memset(transition, 0, sizeof(*transition));
+
+    if (channels > TRANSITION_MAX_CHANNELS)
+        channels = TRANSITION_MAX_CHANNELS;
+
+    transition->channels = channels;
+    transition->duration_ms = duration_ms;
+    transition->curve = curve;
+}
+
+
+void transition_configure(transition_t *transition, uint32_t duration_ms,
+                          transition_curve_t curve) {
+    transition->duration_ms = duration_ms;
+    transition->curve = curve;
+}
+
+
+static uint32_t transition_ease(transition_curve_t curve, uint32_t p) {
+    uint32_t q;
+
+    switch (curve) {
+        case TRANSITION_EASE_IN:
+            return (p * p) >> 15;
+        case TRANSITION_EASE_OUT:
+            q = TRANSITION_ONE - p;
+            return TRANSITION_ONE - ((q * q) >> 15);
+        case TRANSITION_EASE_IN_OUT:
+            // p^2 * (3 - 2p), never more than 1.0 so it stays within 2^30
+            return (((p * p) >> 15) * (3 * TRANSITION_ONE - 2 * p)) >> 15;
+        default:
+            return p;
+    }
+}
+
+
+void transition_set_target(transition_t *transition, const uint16_t *target,
+                           uint32_t now_ms) {
+    bool changed = false;
+    for (uint8_t i = 0; i < transition->channels; i++) {
+        transition->from[i] = transition->value[i];
+        transition->to[i] = target[i];
+        changed |= transition->value[i] != target[i];
+    }
+
+    transition->start_ms = now_ms;
+    transition->active = changed;
+
+    if (changed && transition->duration_ms == 0)
+        transition_step(transition, now_ms);
+}
+
+
+bool transition_step(transition_t *transition, uint32_t now_ms) {
+    if (!transition->active)
+        return false;
+
+    uint32_t elapsed = now_ms - transition->start_ms;
+    if (elapsed >= transition->duration_ms) {
+        memcpy(transition->value, transition->to, transition->channels * sizeof(uint16_t));
+        transition->active = false;
+        return false;
+    }
+
+    uint32_t p = ((uint64_t)elapsed << 15) / transition->duration_ms;
+    int32_t e = transition_ease(transition->curve, p);
+
+    for (uint8_t i = 0; i < transition->channels; i++) {
+        // 65535 * 32768 still fits into int32
+        int32_t delta = (int32_t)transition->to[i] - transition->from[i];
+        transition->value[i] = transition->from[i] + ((delta * e) >> 15);
+    }
+
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+    Fixed-point fade between two light levels.
+
+    Channel values are linear light (e.g. PWM duty after color_gamma16(), or
+    color_hsi2rgb() output at scale 0xffff), so a half way point gives half
+    the light and colors don't pass through darker or shifted hues. The
+    engine keeps no clock of its own: the caller passes the time in
+    milliseconds and stops calling transition_step() once it returns false.
+*/
+
+#define TRANSITION_MAX_CHANNELS 4
+
+typedef enum {
+    TRANSITION_LINEAR = 0,
+    TRANSITION_EASE_IN,         // starts slow, p^2
+    TRANSITION_EASE_OUT,        // ends slow, 1 - (1 - p)^2
+    TRANSITION_EASE_IN_OUT,     // smoothstep, 3p^2 - 2p^3
+} transition_curve_t;
+
+typedef struct {
+    uint8_t channels;
+    transition_curve_t curve;
+    uint32_t duration_ms;
+
+    bool active;
+    uint32_t start_ms;
+    uint16_t from[TRANSITION_MAX_CHANNELS];
+    uint16_t to[TRANSITION_MAX_CHANNELS];
+    uint16_t value[TRANSITION_MAX_CHANNELS];    // current output
+} transition_t;
+
+/**
+    Sets up an idle transition with all channels at 0.
+
+    @param channels Number of channels, up to TRANSITION_MAX_CHANNELS
+    @param duration_ms Length of a fade, 0 jumps straight to the target
+    @param curve Easing applied to the fade progress
+*/
+void transition_init(transition_t *transition, uint8_t channels,
+                     uint32_t duration_ms, transition_curve_t curve);
+
+/**
+    Changes fade length and curve, a fade already running keeps its own.
+*/
+void transition_configure(transition_t *transition, uint32_t duration_ms,
+                          transition_curve_t curve);
+
+/**
+    Starts a fade from the current value to the target. A new target during
+    a fade starts from wherever the old one got to, so there are no jumps.
+
+    @param target Values for all channels
+    @param now_ms Current time in milliseconds
+*/
+void transition_set_target(transition_t *transition, const uint16_t *target,
+                           uint32_t now_ms);
+
+/**
+    Moves the value along the fade.
+
+    @param now_ms Current time in milliseconds
+    @return true while the fade is still running, false once the value has
+            reached the target and the caller can sleep until the next one
+*/
+bool transition_step(transition_t *transition, uint32_t now_ms);
+
+static inline bool transition_active(const transition_t *transition) {
+    return transition->active;
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+#include <espressif/esp_common.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include "animation.h"
+
+
+#define TICKS_PER_SECOND (1000 / portTICK_PERIOD_MS)
+
+static animation_t *animations = NULL;
+static SemaphoreHandle_t animation_lock = NULL;
+static TaskHandle_t animation_task_handle = NULL;
+
+
+// Frame functions run with the lock held, so calls made
+// from the scheduler task don't take it again
+static bool animation_lock_take() {
+    if (xTaskGetCurrentTaskHandle() == animation_task_handle)
+        return false;
+
+    xSemaphoreTake(animation_lock, portMAX_DELAY);
+    return true;
+}
+
+static void animation_lock_give(bool taken) {
+    if (taken)
+        xSemaphoreGive(animation_lock);
+}
+
+
+static uint8_t histogram_bucket(uint32_t value) {
+    uint8_t bucket = value ? 32 - __builtin_clz(value) : 0;
+    return (bucket < ANIMATION_HISTOGRAM_SIZE) ? bucket : ANIMATION_HISTOGRAM_SIZE - 1;
+}
+
+
+static void animation_advance(animation_t *animation) {
+    // Frames of a second are spread over its ticks, so rates
+    // that don't divide the tick rate still average out exactly
+    if (++animation->second_frame == animation->fps) {
+        animation->second_frame = 0;
+        animation->second_start += TICKS_PER_SECOND;
+    }
+    animation->due = animation->second_start +
+        animation->second_frame * TICKS_PER_SECOND / animation->fps;
+}
+
+
+static void animation_run(animation_t *animation, TickType_t late) {
+    animation_stats_t *stats = &animation->stats;
+
+    uint32_t start = sdk_system_get_time();
+    bool keep = animation->frame(animation->context);
+    uint32_t compute = sdk_system_get_time() - start;
+
+    stats->frames++;
+    stats->compute_us = compute;
+    if (compute > stats->compute_max_us)
+        stats->compute_max_us = compute;
+    stats->compute[histogram_bucket(compute / 1000)]++;
+    stats->lateness[histogram_bucket(late)]++;
+
+    if (!keep)
+        animation->active = false;
+
+    if (!animation->active)
+        return;
+
+    TickType_t now = xTaskGetTickCount();
+    animation_advance(animation);
+    while ((int32_t)(now - animation->due) > 0) {
+        animation_advance(animation);
+        stats->dropped++;
+    }
+}
+
+
+static void animation_task(void *_args) {
+    while (true) {
+        TickType_t wait = portMAX_DELAY;
+
+        xSemaphoreTake(animation_lock, portMAX_DELAY);
+
+        for (animation_t *animation = animations; animation; animation = animation->next) {
+            if (!animation->active)
+                continue;
+
+            TickType_t now = xTaskGetTickCount();
+            int32_t late = now - animation->due;
+            if (late >= 0) {
+                animation_run(animation, late);
+                if (!animation->active)
+                    continue;
+
+                now = xTaskGetTickCount();
+            }
+
+            int32_t left = animation->due - now;
+            if (left < 0)
+                left = 0;
+            if ((TickType_t)left < wait)
+                wait = left;
+        }
+
+        xSemaphoreGive(animation_lock);
+
+        // Starting an animation wakes the task early
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+
+int animation_register(animation_t *animation, const char *name, uint16_t fps,
+                       animation_frame_fn frame, void *context) {
+    if (!fps)
+        return -1;
+
+    if (!animation_lock) {
+        animation_lock = xSemaphoreCreateMutex();
+        if (!animation_lock)
+            return -1;
+
+        if (xTaskCreate(animation_task, "Animation", ANIMATION_TASK_STACK, NULL,
+                        ANIMATION_TASK_PRIORITY, &animation_task_handle) != pdPASS) {
+            vSemaphoreDelete(animation_lock);
+            animation_lock = NULL;
+            return -1;
+        }
+    }
+
+    memset(animation, 0, sizeof(*animation));
+    animation->name = name;
+    animation->fps = fps;
+    animation->frame = frame;
+    animation->context = context;
+
+    bool taken = animation_lock_take();
+    animation->next = animations;
+    animations = animation;
+    animation_lock_give(taken);
+
+    return 0;
+}
+
+
+void animation_start(animation_t *animation) {
+    bool taken = animation_lock_take();
+
+    memset(&animation->stats, 0, sizeof(animation->stats));
+    animation->second_start = xTaskGetTickCount();
+    animation->second_frame = 0;
+    animation->due = animation->second_start;
+    animation->active = true;
+
+    animation_lock_give(taken);
+
+    xTaskNotifyGive(animation_task_handle);
+}
+
+
+void animation_stop(animation_t *animation) {
+    bool taken = animation_lock_take();
+    animation->active = false;
+    animation_lock_give(taken);
+}
+
+
+bool animation_active(const animation_t *animation) {
+    return animation->active;
+}
+
+
+void animation_get_stats(const animation_t *animation, animation_stats_t *stats) {
+    bool taken = animation_lock_take();
+    *stats = animation->stats;
+    animation_lock_give(taken);
+}
+
+
+static void print_histogram(const char *title, const uint32_t *histogram) {
+    printf("  %s:", title);
+    for (int i = 0; i < ANIMATION_HISTOGRAM_SIZE; i++)
+        printf(" %u", histogram[i]);
+    printf("\n");
+}
+
+
+void animation_print_stats(const animation_t *animation) {
+    animation_stats_t stats;
+    animation_get_stats(animation, &stats);
+
+    printf("%s: %u frames at %u FPS, %u dropped, compute %u us (max %u)\n",
+           animation->name, stats.frames, animation->fps, stats.dropped,
+           stats.compute_us, stats.compute_max_us);
+    print_histogram("compute ms (0, 1, 2-3, 4-7, ...)", stats.compute);
+    print_histogram("late ticks (0, 1, 2-3, 4-7, ...)", stats.lateness);
+}
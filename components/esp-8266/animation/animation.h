@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <FreeRTOS.h>
+
+/**
+    Fixed rate animation scheduler.
+
+    Registered animations are run by one scheduler task, each at its own
+    frame rate. Frame times follow a fixed timeline from the moment the
+    animation was started, so the rate doesn't drift with the time frames
+    take to compute. Frames whose time has already passed are dropped.
+*/
+
+#define ANIMATION_HISTOGRAM_SIZE 8
+
+#ifndef ANIMATION_TASK_STACK
+#define ANIMATION_TASK_STACK 512
+#endif
+
+#ifndef ANIMATION_TASK_PRIORITY
+#define ANIMATION_TASK_PRIORITY 2
+#endif
+
+/**
+    Frame timing of an animation since it was started.
+
+    Histogram bucket 0 counts values of 0, bucket k values from 2^(k-1)
+    to 2^k - 1, and the last bucket everything above.
+*/
+typedef struct {
+    uint32_t frames;
+    uint32_t dropped;           // frames skipped to get back on the timeline
+
+    uint32_t compute_us;        // time of the last frame
+    uint32_t compute_max_us;
+
+    uint32_t compute[ANIMATION_HISTOGRAM_SIZE];     // in milliseconds
+    uint32_t lateness[ANIMATION_HISTOGRAM_SIZE];    // in ticks
+} animation_stats_t;
+
+/**
+    Renders and shows one frame.
+
+    @return false to stop the animation after this frame
+*/
+typedef bool (*animation_frame_fn)(void *context);
+
+typedef struct animation {
+    const char *name;
+    uint16_t fps;
+    animation_frame_fn frame;
+    void *context;
+
+    bool active;
+    TickType_t second_start;    // timeline is anchored once a second
+    uint16_t second_frame;
+    TickType_t due;
+
+    animation_stats_t stats;
+    struct animation *next;
+} animation_t;
+
+/**
+    Registers an animation with the scheduler, starting scheduler task
+    on first use. Animation is registered stopped.
+
+    @return A negative integer if this method fails.
+*/
+int animation_register(animation_t *animation, const char *name, uint16_t fps,
+                       animation_frame_fn frame, void *context);
+
+/**
+    Starts (or restarts) an animation, first frame is rendered right away.
+    Frame statistics are reset.
+*/
+void animation_start(animation_t *animation);
+
+/**
+    Stops an animation. Once this returns, no frame of it is being rendered.
+    Can also be called from frame functions.
+*/
+void animation_stop(animation_t *animation);
+
+bool animation_active(const animation_t *animation);
+
+/**
+    Copies frame statistics of an animation.
+*/
+void animation_get_stats(const animation_t *animation, animation_stats_t *stats);
+
+void animation_print_stats(const animation_t *animation);
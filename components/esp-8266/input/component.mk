@@ -0,0 +1,7 @@
+# Component makefile for input
+
+INC_DIRS += $(input_ROOT)
+
+input_SRC_DIR = $(input_ROOT)
+
+$(eval $(call component_compile_rules,input))
@@ -0,0 +1,212 @@
+#include <string.h>
+#include "gesture.h"
+
+
+typedef enum {
+    STATE_IDLE = 0,
+    STATE_DOWN,                 // pressed, long press pending
+    STATE_UP,                   // released, waiting for another press
+    STATE_HELD,                 // long press reported, repeating
+    STATE_COUNT,
+} gesture_state_id_t;
+
+typedef enum {
+    TRIGGER_PRESS = 0,
+    TRIGGER_RELEASE,
+    TRIGGER_TIMEOUT,
+    TRIGGER_COUNT,
+} gesture_trigger_t;
+
+typedef enum {
+    ACTION_NONE = 0,
+    ACTION_FIRST_PRESS,
+    ACTION_NEXT_PRESS,
+    ACTION_RELEASE,
+    ACTION_PRESSES,
+    ACTION_LONG,
+    ACTION_REPEAT,
+    ACTION_END_HOLD,
+} gesture_action_t;
+
+// What every trigger does in every state of a button
+static const uint8_t transitions[STATE_COUNT][TRIGGER_COUNT] = {
+    //                  press               release             timeout
+    [STATE_IDLE] = {    ACTION_FIRST_PRESS, ACTION_NONE,        ACTION_NONE },
+    [STATE_DOWN] = {    ACTION_NONE,        ACTION_RELEASE,     ACTION_LONG },
+    [STATE_UP] = {      ACTION_NEXT_PRESS,  ACTION_NONE,        ACTION_PRESSES },
+    [STATE_HELD] = {    ACTION_NONE,        ACTION_END_HOLD,    ACTION_REPEAT },
+};
+
+
+static inline bool time_reached(uint32_t now_ms, uint32_t time_ms) {
+    return (int32_t)(now_ms - time_ms) >= 0;
+}
+
+
+static void gesture_arm(gesture_state_t *input, uint32_t time_ms, uint16_t delay_ms) {
+    input->deadline_set = delay_ms != 0;
+    input->deadline_ms = time_ms + delay_ms;
+}
+
+
+static void gesture_run(gesture_state_t *input, gesture_trigger_t trigger, uint32_t now_ms,
+                        gesture_fn emit, void *context) {
+    const gesture_config_t *config = &input->config;
+
+    switch (transitions[input->state][trigger]) {
+        case ACTION_FIRST_PRESS:
+            input->presses = 0;
+            // fall through
+        case ACTION_NEXT_PRESS:
+            input->presses++;
+            input->state = STATE_DOWN;
+            gesture_arm(input, now_ms, config->long_ms);
+            break;
+
+        case ACTION_RELEASE:
+            if (input->presses < config->max_presses) {
+                input->state = STATE_UP;
+                gesture_arm(input, now_ms, config->press_window_ms);
+                break;
+            }
+            // fall through
+        case ACTION_PRESSES:
+            input->state = STATE_IDLE;
+            input->deadline_set = false;
+            emit(GESTURE_SINGLE + input->presses - 1, context);
+            break;
+
+        case ACTION_LONG:
+            input->state = STATE_HELD;
+            gesture_arm(input, input->deadline_ms, config->repeat_ms);
+            emit(GESTURE_LONG, context);
+            break;
+
+        case ACTION_REPEAT:
+            gesture_arm(input, input->deadline_ms, config->repeat_ms);
+            emit(GESTURE_HOLD, context);
+            break;
+
+        case ACTION_END_HOLD:
+            input->state = STATE_IDLE;
+            input->deadline_set = false;
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+static void gesture_accept(gesture_state_t *input, uint8_t level, uint32_t now_ms,
+                           gesture_fn emit, void *context) {
+    input->level = level;
+    input->edge_ms = now_ms;
+
+    bool active = level == input->config.active_level;
+    if (input->config.mode == GESTURE_MODE_TOGGLE) {
+        emit(active ? GESTURE_ON : GESTURE_OFF, context);
+    } else {
+        gesture_run(input, active ? TRIGGER_PRESS : TRIGGER_RELEASE, now_ms, emit, context);
+    }
+}
+
+
+void gesture_init(gesture_state_t *input, const gesture_config_t *config,
+                  uint8_t level, uint32_t now_ms) {
+    memset(input, 0, sizeof(*input));
+    input->config = *config;
+
+    if (input->config.max_presses < 1)
+        input->config.max_presses = 1;
+    if (input->config.max_presses > 3)
+        input->config.max_presses = 3;
+    if (!input->config.press_window_ms)
+        input->config.max_presses = 1;
+
+    input->level = level;
+    input->raw_level = level;
+    input->filter = level ? UINT16_MAX : 0;
+    input->edge_ms = now_ms - config->debounce_ms;
+}
+
+
+void gesture_edge(gesture_state_t *input, uint8_t level, uint32_t now_ms,
+                  gesture_fn emit, void *context) {
+    input->raw_level = level;
+    if (level == input->level)
+        return;
+
+    if (input->config.filter_shift) {
+        // The filter takes over from here, sampling on every tick
+        if (!input->sampling) {
+            input->sampling = true;
+            input->sample_ms = now_ms;
+        }
+        return;
+    }
+
+    // Within debounce time the edge is left to gesture_tick(), which
+    // takes whatever level the input settled at
+    if (!time_reached(now_ms, input->edge_ms + input->config.debounce_ms))
+        return;
+
+    gesture_accept(input, level, now_ms, emit, context);
+}
+
+
+static void gesture_sample(gesture_state_t *input, uint8_t level, uint32_t now_ms,
+                           gesture_fn emit, void *context) {
+    int32_t step = ((level ? UINT16_MAX : 0) - (int32_t)input->filter) >> input->config.filter_shift;
+    input->filter += step;
+
+    uint8_t filtered = input->filter > UINT16_MAX / 2;
+    if (filtered != input->level)
+        gesture_accept(input, filtered, now_ms, emit, context);
+
+    // Once a sample no longer moves the filter, further ones could not
+    // either until the level changes, and that comes with an edge
+    if (step) {
+        input->sample_ms = now_ms + input->config.sample_ms;
+    } else {
+        input->sampling = false;
+    }
+}
+
+
+uint32_t gesture_tick(gesture_state_t *input, uint8_t level, uint32_t now_ms,
+                      gesture_fn emit, void *context) {
+    uint32_t settle_ms = input->edge_ms + input->config.debounce_ms;
+    bool settling = false;
+
+    if (input->config.filter_shift) {
+        if (input->sampling && time_reached(now_ms, input->sample_ms))
+            gesture_sample(input, level, now_ms, emit, context);
+
+        settling = input->sampling;
+        settle_ms = input->sample_ms;
+    } else {
+        input->raw_level = level;
+        settling = level != input->level;
+
+        if (settling && time_reached(now_ms, settle_ms)) {
+            gesture_accept(input, level, now_ms, emit, context);
+            settling = false;
+        }
+    }
+
+    // Repeats that fell behind are caught up one per tick
+    if (input->deadline_set && time_reached(now_ms, input->deadline_ms))
+        gesture_run(input, TRIGGER_TIMEOUT, now_ms, emit, context);
+
+    uint32_t wait = GESTURE_IDLE;
+    if (settling)
+        wait = time_reached(now_ms, settle_ms) ? 0 : settle_ms - now_ms;
+    if (input->deadline_set) {
+        uint32_t deadline = time_reached(now_ms, input->deadline_ms) ? 0 : input->deadline_ms - now_ms;
+        if (deadline < wait)
+            wait = deadline;
+    }
+
+    return wait;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+    Gesture recognition for one digital input.
+
+    Plain state machine without any OS or hardware dependency: it is fed
+    with edges and the current time in milliseconds, and asks to be ticked
+    again when a press window or long press runs out.
+
+    Edges are debounced by time, or with filter_shift set, an edge starts
+    sampling the level through a low-pass filter until the filter stops
+    moving. Either way nothing is ticked while the input is at rest.
+*/
+
+#define GESTURE_IDLE UINT32_MAX     // gesture_tick() result, nothing pending
+
+typedef enum {
+    GESTURE_MODE_BUTTON = 0,        // presses, long press and hold
+    GESTURE_MODE_TOGGLE,            // every level change of a switch
+} gesture_mode_t;
+
+typedef enum {
+    GESTURE_SINGLE = 0,
+    GESTURE_DOUBLE,
+    GESTURE_TRIPLE,
+    GESTURE_LONG,                   // held for long_ms
+    GESTURE_HOLD,                   // every repeat_ms while still held after GESTURE_LONG
+    GESTURE_ON,                     // toggle mode, input became active
+    GESTURE_OFF,                    // toggle mode, input became inactive
+} gesture_t;
+
+typedef struct {
+    gesture_mode_t mode;
+    uint8_t active_level;           // GPIO level when pressed or switched on
+    uint16_t debounce_ms;           // edges closer than this after an accepted one are bounce
+    uint8_t filter_shift;           // 0 debounces by time, else filter weight is 1/2^filter_shift
+    uint16_t sample_ms;             // filter sample interval
+
+    // Button mode only
+    uint8_t max_presses;            // 1-3, with 1 a press is reported right at release
+    uint16_t press_window_ms;       // longest pause between presses of a double or triple
+    uint16_t long_ms;               // 0 disables long press
+    uint16_t repeat_ms;             // 0 disables hold repeat
+} gesture_config_t;
+
+#define GESTURE_CONFIG_BUTTON(_long_ms) { \
+    .mode = GESTURE_MODE_BUTTON, \
+    .active_level = 0, \
+    .debounce_ms = 50, \
+    .max_presses = 1, \
+    .press_window_ms = 400, \
+    .long_ms = (_long_ms), \
+    .repeat_ms = 0, \
+}
+
+#define GESTURE_CONFIG_TOGGLE(_active_level) { \
+    .mode = GESTURE_MODE_TOGGLE, \
+    .active_level = (_active_level), \
+    .debounce_ms = 50, \
+}
+
+// Switch on long wires, a new level has to hold for 6 samples, 60 ms
+#define GESTURE_CONFIG_TOGGLE_FILTERED(_active_level) { \
+    .mode = GESTURE_MODE_TOGGLE, \
+    .active_level = (_active_level), \
+    .filter_shift = 3, \
+    .sample_ms = 10, \
+}
+
+typedef void (*gesture_fn)(gesture_t gesture, void *context);
+
+typedef struct {
+    gesture_config_t config;
+
+    uint8_t state;
+    uint8_t presses;
+    uint8_t level;                  // debounced level
+    uint8_t raw_level;              // level after the last edge seen
+    bool deadline_set;
+    bool sampling;
+    uint16_t filter;                // low-pass filtered level, 0-UINT16_MAX
+
+    uint32_t edge_ms;               // time of the last accepted edge
+    uint32_t deadline_ms;
+    uint32_t sample_ms;             // time of the next filter sample
+} gesture_state_t;
+
+/**
+    Starts recognition, no gesture is reported for the initial level.
+*/
+void gesture_init(gesture_state_t *input, const gesture_config_t *config,
+                  uint8_t level, uint32_t now_ms);
+
+/**
+    Feeds an edge, reporting any gesture it completes through emit.
+
+    @param level GPIO level after the edge
+    @param now_ms Time of the edge
+*/
+void gesture_edge(gesture_state_t *input, uint8_t level, uint32_t now_ms,
+                  gesture_fn emit, void *context);
+
+/**
+    Runs timeouts and filter samples that are due, reporting gestures
+    through emit.
+
+    @param level Current GPIO level
+    @return Milliseconds until the input needs another tick,
+            GESTURE_IDLE when it can wait for the next edge.
+*/
+uint32_t gesture_tick(gesture_state_t *input, uint8_t level, uint32_t now_ms,
+                      gesture_fn emit, void *context);
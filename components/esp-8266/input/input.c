@@ -0,0 +1,147 @@
+#include <string.h>
+#include <esp/gpio.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <input_dispatch.h>
+#include "input.h"
+
+
+typedef struct {
+    uint8_t gpio_num;
+    input_callback_fn callback;     // NULL for a free slot
+    void *context;
+
+    gesture_state_t gesture;
+} input_t;
+
+static input_t inputs[INPUT_MAX_COUNT];
+static input_stats_t stats;
+
+// Inputs that had an edge or asked for another tick, the rest are at
+// rest and the tick doesn't even look at them. Both masks are also
+// changed by input_create()/input_delete() on the caller's task, so
+// they are only read-modify-written in a critical section.
+static uint32_t pending = 0;
+static uint32_t gpio_mask = 0;
+
+
+static void input_emit(gesture_t gesture, void *context) {
+    input_t *input = context;
+    // An edge handled while the input is deleted finds no callback
+    input_callback_fn callback = input->callback;
+    if (callback)
+        callback(input->gpio_num, gesture, input->context);
+}
+
+
+// Also gets the level after edges lost to a full queue, the tick then
+// settles the gesture on it
+static void input_edge_callback(const input_event_t *event, void *context) {
+    input_t *input = context;
+    gesture_edge(&input->gesture, event->level, event->time * portTICK_PERIOD_MS,
+                 input_emit, input);
+
+    taskENTER_CRITICAL();
+    pending |= BIT(input - inputs);
+    taskEXIT_CRITICAL();
+}
+
+
+static TickType_t input_tick(TickType_t now) {
+    uint32_t now_ms = now * portTICK_PERIOD_MS;
+    uint32_t wait = GESTURE_IDLE;
+
+    stats.ticks++;
+
+    taskENTER_CRITICAL();
+    uint32_t scan = pending;
+    uint32_t mask = gpio_mask;
+    taskEXIT_CRITICAL();
+
+    // One snapshot serves all inputs
+    uint32_t levels = input_dispatch_read(mask);
+
+    for (int i = 0; i < INPUT_MAX_COUNT; i++) {
+        if (!(scan & BIT(i)))
+            continue;
+
+        input_t *input = &inputs[i];
+        uint8_t level = (levels >> input->gpio_num) & 1;
+        uint32_t input_wait = gesture_tick(&input->gesture, level, now_ms, input_emit, input);
+        stats.scans++;
+
+        if (input_wait == GESTURE_IDLE) {
+            taskENTER_CRITICAL();
+            pending &= ~BIT(i);
+            taskEXIT_CRITICAL();
+        }
+        if (input_wait < wait)
+            wait = input_wait;
+    }
+
+    if (wait == GESTURE_IDLE) {
+        stats.idle_ticks++;
+        return portMAX_DELAY;
+    }
+
+    // Rounded up, a tick too early would only find nothing due
+    return (wait + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+}
+
+
+int input_create(uint8_t gpio_num, const gesture_config_t *config,
+                 input_callback_fn callback, void *context) {
+    if (!callback)
+        return -1;
+
+    input_t *input = NULL;
+    for (int i = 0; i < INPUT_MAX_COUNT; i++) {
+        if (!inputs[i].callback) {
+            input = &inputs[i];
+            break;
+        }
+    }
+    if (!input)
+        return -1;
+
+    gpio_enable(gpio_num, GPIO_INPUT);
+    gpio_set_pullup(gpio_num, true, true);
+
+    memset(input, 0, sizeof(*input));
+    input->gpio_num = gpio_num;
+    input->context = context;
+    gesture_init(&input->gesture, config, gpio_read(gpio_num),
+                 xTaskGetTickCount() * portTICK_PERIOD_MS);
+
+    // Slot is taken once the callback is set, the tick skips it before
+    input->callback = callback;
+
+    input_dispatch_set_tick(input_tick);
+    if (input_dispatch_attach(gpio_num, GPIO_INTTYPE_EDGE_ANY, input_edge_callback, input)) {
+        input->callback = NULL;
+        return -1;
+    }
+    taskENTER_CRITICAL();
+    gpio_mask |= BIT(gpio_num);
+    taskEXIT_CRITICAL();
+
+    return 0;
+}
+
+
+void input_delete(uint8_t gpio_num) {
+    input_t *input = input_dispatch_detach(gpio_num, input_edge_callback);
+    if (!input)
+        return;
+
+    taskENTER_CRITICAL();
+    pending &= ~BIT(input - inputs);
+    gpio_mask &= ~BIT(gpio_num);
+    taskEXIT_CRITICAL();
+    input->callback = NULL;
+}
+
+
+const input_stats_t *input_get_stats() {
+    return &stats;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include "gesture.h"
+
+/**
+    Buttons, switches and sensors on GPIOs, recognized by one engine.
+
+    Edges come through input_dispatch and every input runs its own
+    gesture_config_t. Timeouts and filter samples of all inputs share the
+    input task's single wakeup, so there is no timer per input and nothing
+    runs while no input is moving. Callbacks run in the input task.
+*/
+
+#ifndef INPUT_MAX_COUNT
+#define INPUT_MAX_COUNT 8     // at most 32
+#endif
+
+typedef struct {
+    uint32_t ticks;             // runs of the tick, after edges and for timeouts or filters
+    uint32_t idle_ticks;        // ticks after which no input needed another one
+    uint32_t scans;             // inputs ticked, ones at rest are skipped
+} input_stats_t;
+
+typedef void (*input_callback_fn)(uint8_t gpio_num, gesture_t gesture, void *context);
+
+/**
+    Starts recognizing gestures on a GPIO, with its pull-up enabled.
+
+    @param config Gestures to recognize, copied
+    @param callback Called with every recognized gesture
+    @param context Passed to the callback
+    @return A negative integer if this method fails.
+*/
+int input_create(uint8_t gpio_num, const gesture_config_t *config,
+                 input_callback_fn callback, void *context);
+
+/**
+    Stops monitoring a GPIO.
+*/
+void input_delete(uint8_t gpio_num);
+
+const input_stats_t *input_get_stats();
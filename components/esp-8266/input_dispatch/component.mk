@@ -0,0 +1,7 @@
+# Component makefile for input_dispatch
+
+INC_DIRS += $(input_dispatch_ROOT)
+
+input_dispatch_SRC_DIR = $(input_dispatch_ROOT)
+
+$(eval $(call component_compile_rules,input_dispatch))
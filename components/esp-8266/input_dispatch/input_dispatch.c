@@ -0,0 +1,186 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <xtensa_ops.h>
+#include <common_macros.h>
+#include <task.h>
+#include "input_dispatch.h"
+
+
+#if INPUT_DISPATCH_QUEUE_SIZE & (INPUT_DISPATCH_QUEUE_SIZE - 1)
+#error INPUT_DISPATCH_QUEUE_SIZE must be a power of 2
+#endif
+
+typedef struct {
+    input_dispatch_fn handler;
+    void *context;
+} input_dispatch_entry_t;
+
+static input_dispatch_entry_t entries[INPUT_DISPATCH_GPIO_COUNT];
+static input_dispatch_stats_t stats;
+static TaskHandle_t input_task_handle = NULL;
+static input_dispatch_tick_fn input_tick = NULL;
+
+// Single producer ring: only the interrupt moves head and only the
+// input task moves tail, both run free and wrap at 2^16
+static input_event_t queue[INPUT_DISPATCH_QUEUE_SIZE];
+static volatile uint16_t queue_head = 0;
+static volatile uint16_t queue_tail = 0;
+
+// GPIOs that lost edges to a full queue, the input task then sends
+// their handlers the current level
+static volatile uint32_t overflow_mask = 0;
+
+
+static IRAM void input_dispatch_intr_callback(uint8_t gpio_num) {
+    uint32_t start, end;
+    RSR(start, ccount);
+
+    uint16_t head = queue_head;
+    uint16_t pending = (uint16_t)(head - queue_tail);
+
+    if (pending < INPUT_DISPATCH_QUEUE_SIZE) {
+        input_event_t *event = &queue[head & (INPUT_DISPATCH_QUEUE_SIZE - 1)];
+        event->time = xTaskGetTickCountFromISR();
+        event->gpio_num = gpio_num;
+        event->level = gpio_read(gpio_num);
+        event->overflow = false;
+
+        // Event is complete before the task can see it
+        queue_head = head + 1;
+        if (++pending > stats.max_pending)
+            stats.max_pending = pending;
+
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(input_task_handle, &woken);
+        portEND_SWITCHING_ISR(woken);
+    } else {
+        stats.overflows++;
+        overflow_mask |= BIT(gpio_num);
+    }
+
+    RSR(end, ccount);
+    stats.interrupts++;
+    stats.cycles = end - start;
+    if (stats.cycles > stats.max_cycles)
+        stats.max_cycles = stats.cycles;
+}
+
+
+static void input_dispatch_deliver(const input_event_t *event) {
+    // Copied at once, so a detach can't leave a handler with a cleared context
+    taskENTER_CRITICAL();
+    input_dispatch_entry_t entry = entries[event->gpio_num];
+    taskEXIT_CRITICAL();
+
+    if (entry.handler) {
+        entry.handler(event, entry.context);
+        stats.events++;
+    }
+}
+
+
+static void input_dispatch_resync() {
+    taskENTER_CRITICAL();
+    uint32_t lost = overflow_mask;
+    uint32_t overflows = stats.overflows;
+    overflow_mask = 0;
+    taskEXIT_CRITICAL();
+
+    printf("Input: queue full, %u edges dropped so far\n", overflows);
+
+    // Handlers catch up with the level the lost edges left behind
+    input_event_t event = { .time = xTaskGetTickCount(), .overflow = true };
+    for (uint8_t gpio_num = 0; gpio_num < 16; gpio_num++) {
+        if (lost & BIT(gpio_num)) {
+            event.gpio_num = gpio_num;
+            event.level = gpio_read(gpio_num);
+            input_dispatch_deliver(&event);
+        }
+    }
+}
+
+
+static void input_dispatch_task(void *_args) {
+    TickType_t wait = portMAX_DELAY;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        uint16_t tail = queue_tail;
+        while (tail != queue_head) {
+            input_event_t event = queue[tail & (INPUT_DISPATCH_QUEUE_SIZE - 1)];
+            // Slot is free for the interrupt once copied
+            queue_tail = ++tail;
+
+            input_dispatch_deliver(&event);
+        }
+
+        if (overflow_mask)
+            input_dispatch_resync();
+
+        input_dispatch_tick_fn tick = input_tick;
+        wait = tick ? tick(xTaskGetTickCount()) : portMAX_DELAY;
+    }
+}
+
+
+int input_dispatch_attach(uint8_t gpio_num, gpio_inttype_t type,
+                          input_dispatch_fn handler, void *context) {
+    if (gpio_num >= INPUT_DISPATCH_GPIO_COUNT || !handler)
+        return -1;
+    if (gpio_num == 16 && type != GPIO_INTTYPE_NONE)
+        return -1;
+
+    input_dispatch_entry_t *entry = &entries[gpio_num];
+    if (entry->handler)
+        return -1;
+
+    if (!input_task_handle) {
+        if (xTaskCreate(input_dispatch_task, "Input", INPUT_DISPATCH_TASK_STACK, NULL,
+                        INPUT_DISPATCH_TASK_PRIORITY, &input_task_handle) != pdPASS) {
+            input_task_handle = NULL;
+            return -1;
+        }
+    }
+
+    // Interrupt is only enabled below, once the entry is complete
+    entry->context = context;
+    entry->handler = handler;
+
+    if (gpio_num < 16 && type != GPIO_INTTYPE_NONE)
+        gpio_set_interrupt(gpio_num, type, input_dispatch_intr_callback);
+
+    return 0;
+}
+
+
+void *input_dispatch_detach(uint8_t gpio_num, input_dispatch_fn handler) {
+    if (gpio_num >= INPUT_DISPATCH_GPIO_COUNT)
+        return NULL;
+
+    input_dispatch_entry_t *entry = &entries[gpio_num];
+    if (!entry->handler || entry->handler != handler)
+        return NULL;
+
+    if (gpio_num < 16)
+        gpio_set_interrupt(gpio_num, GPIO_INTTYPE_NONE, NULL);
+
+    // Input task copies the entry in a critical section too
+    taskENTER_CRITICAL();
+    void *context = entry->context;
+    entry->handler = NULL;
+    entry->context = NULL;
+    taskEXIT_CRITICAL();
+
+    return context;
+}
+
+
+void input_dispatch_set_tick(input_dispatch_tick_fn tick) {
+    input_tick = tick;
+}
+
+
+const input_dispatch_stats_t *input_dispatch_get_stats() {
+    return &stats;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp/gpio.h>
+#include <FreeRTOS.h>
+
+/**
+    GPIO interrupt dispatch shared by all input drivers.
+
+    One static entry per GPIO holds the driver's handler and its state, so
+    an edge reaches the right button or sensor with a single index instead
+    of a search, however many inputs there are.
+
+    The interrupt itself only records the edge: GPIO, level and time go
+    into a lock-free ring that is drained by one input task, which calls
+    the handlers. Drivers and their user callbacks therefore run in task
+    context and may print, notify HomeKit or block briefly.
+*/
+
+#define INPUT_DISPATCH_GPIO_COUNT 17    // GPIO0-GPIO16
+
+#ifndef INPUT_DISPATCH_QUEUE_SIZE
+#define INPUT_DISPATCH_QUEUE_SIZE 32    // power of 2
+#endif
+
+#ifndef INPUT_DISPATCH_TASK_STACK
+#define INPUT_DISPATCH_TASK_STACK 512
+#endif
+
+#ifndef INPUT_DISPATCH_TASK_PRIORITY
+#define INPUT_DISPATCH_TASK_PRIORITY 2
+#endif
+
+typedef struct {
+    uint32_t time;              // tick count when the edge came
+    uint8_t gpio_num;
+    uint8_t level;              // GPIO level right after the edge
+    bool overflow;              // edges before it were dropped, level is read
+                                // by the task once the queue is drained
+} input_event_t;
+
+typedef void (*input_dispatch_fn)(const input_event_t *event, void *context);
+
+/**
+    Runs in the input task after every batch of edges and whenever its
+    last result ran out.
+
+    @param now Current tick count
+    @return Ticks until it wants to run again, portMAX_DELAY for never
+*/
+typedef TickType_t (*input_dispatch_tick_fn)(TickType_t now);
+
+typedef struct {
+    uint32_t interrupts;
+    uint32_t cycles;            // of the last interrupt
+    uint32_t max_cycles;
+
+    uint32_t events;            // handled by the input task
+    uint32_t overflows;         // edges dropped because the queue was full,
+                                // also printed by the input task
+    uint16_t max_pending;       // most edges waiting for the task at once
+} input_dispatch_stats_t;
+
+/**
+    Routes edges of a GPIO to a handler, starting the input task with the
+    first one.
+
+    GPIO16 has no interrupt, it can only be claimed with GPIO_INTTYPE_NONE
+    by drivers that poll it.
+
+    @param type Interrupt type, e.g. GPIO_INTTYPE_EDGE_ANY
+    @param handler Called from the input task with the given context
+    @return A negative integer if the GPIO is invalid or already used.
+*/
+int input_dispatch_attach(uint8_t gpio_num, gpio_inttype_t type,
+                          input_dispatch_fn handler, void *context);
+
+/**
+    Disables the interrupt of a GPIO if it belongs to the handler. Edges
+    still queued for it are dropped. A handler call the input task
+    already started may still finish after this returns.
+
+    @return Context of the detached handler, NULL if it wasn't attached.
+*/
+void *input_dispatch_detach(uint8_t gpio_num, input_dispatch_fn handler);
+
+/**
+    Sets the function that handles timeouts of all inputs, see
+    input_dispatch_tick_fn.
+*/
+void input_dispatch_set_tick(input_dispatch_tick_fn tick);
+
+/**
+    Reads the levels of many GPIOs at once, bit n is the level of GPIOn.
+
+    GPIO0-15 come with a single read of the input register. GPIO16 is in
+    the RTC block and costs a second read, only done when it's in mask.
+
+    @param mask GPIOs of interest, others read as 0
+*/
+static inline uint32_t input_dispatch_read(uint32_t mask) {
+    uint32_t levels = GPIO.IN & mask & 0xffff;
+    if (mask & BIT(16))
+        levels |= (RTC.GPIO_IN & 1) << 16;
+
+    return levels;
+}
+
+const input_dispatch_stats_t *input_dispatch_get_stats();
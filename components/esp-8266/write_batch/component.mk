@@ -0,0 +1,7 @@
+# Component makefile for write_batch
+
+INC_DIRS += $(write_batch_ROOT)
+
+write_batch_SRC_DIR = $(write_batch_ROOT)
+
+$(eval $(call component_compile_rules,write_batch))
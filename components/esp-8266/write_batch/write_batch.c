@@ -0,0 +1,49 @@
+#include "write_batch.h"
+
+
+static void write_batch_task(void *_args) {
+    write_batch_t *batch = _args;
+    // First tick of a timeout can be cut short, so one more is added
+    const TickType_t settle = (WRITE_BATCH_SETTLE_MS + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS + 1;
+    const TickType_t max_delay = (WRITE_BATCH_MAX_DELAY_MS + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        TickType_t first = xTaskGetTickCount();
+
+        // Wait for the rest of the batch, a write after max_delay
+        // is left for the next one
+        while (true) {
+            TickType_t waited = xTaskGetTickCount() - first;
+            if (waited >= max_delay)
+                break;
+
+            TickType_t wait = max_delay - waited;
+            if (!ulTaskNotifyTake(pdTRUE, (wait < settle) ? wait : settle))
+                break;
+        }
+
+        batch->applies++;
+        batch->apply(batch->context);
+    }
+}
+
+
+int write_batch_init(write_batch_t *batch, const char *name, uint16_t stack_size,
+                     write_batch_apply_fn apply, void *context) {
+    batch->apply = apply;
+    batch->context = context;
+    batch->writes = 0;
+    batch->applies = 0;
+
+    if (xTaskCreate(write_batch_task, name, stack_size, batch, 2, &batch->task) != pdPASS)
+        return -1;
+
+    return 0;
+}
+
+
+void write_batch_touch(write_batch_t *batch) {
+    batch->writes++;
+    xTaskNotifyGive(batch->task);
+}
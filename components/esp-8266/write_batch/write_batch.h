@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+/**
+    Merges characteristic writes into one hardware update.
+
+    Setters only store their value and call write_batch_touch(). Apply
+    function then runs once on the batch task after writes stop coming
+    for WRITE_BATCH_SETTLE_MS, which covers all characteristics of one
+    controller request. Writes that never stop, like a slider dragged in
+    the Home app, are applied at least every WRITE_BATCH_MAX_DELAY_MS.
+*/
+
+#ifndef WRITE_BATCH_SETTLE_MS
+#define WRITE_BATCH_SETTLE_MS 20
+#endif
+
+#ifndef WRITE_BATCH_MAX_DELAY_MS
+#define WRITE_BATCH_MAX_DELAY_MS 100
+#endif
+
+typedef void (*write_batch_apply_fn)(void *context);
+
+typedef struct {
+    write_batch_apply_fn apply;
+    void *context;
+    TaskHandle_t task;
+
+    uint32_t writes;
+    uint32_t applies;
+} write_batch_t;
+
+/**
+    Creates batch task.
+
+    @return A negative integer if this method fails.
+*/
+int write_batch_init(write_batch_t *batch, const char *name, uint16_t stack_size,
+                     write_batch_apply_fn apply, void *context);
+
+/**
+    Records a write, apply function runs once the batch settles.
+*/
+void write_batch_touch(write_batch_t *batch);
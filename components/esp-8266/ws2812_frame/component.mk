@@ -0,0 +1,7 @@
+# Component makefile for ws2812_frame
+
+INC_DIRS += $(ws2812_frame_ROOT)
+
+ws2812_frame_SRC_DIR = $(ws2812_frame_ROOT)
+
+$(eval $(call component_compile_rules,ws2812_frame))
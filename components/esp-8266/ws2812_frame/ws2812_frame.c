@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <string.h>
+#include <xtensa_ops.h>
+#include "ws2812_frame.h"
+
+
+int ws2812_dither_init(ws2812_dither_t *dither, size_t count) {
+    memset(dither, 0, sizeof(*dither));
+
+    dither->residual = malloc(count * 3);
+    if (!dither->residual)
+        return -1;
+
+    dither->count = count;
+
+    // Golden ratio sequence spreads initial residuals evenly
+    for (size_t i = 0; i < count * 3; i++)
+        dither->residual[i] = (uint32_t)(i * 0x9E3779B9) >> 24;
+
+    return 0;
+}
+
+
+void ws2812_dither_done(ws2812_dither_t *dither) {
+    free(dither->residual);
+    dither->residual = NULL;
+    dither->count = 0;
+}
+
+
+size_t ws2812_dither_ram(const ws2812_dither_t *dither) {
+    return sizeof(*dither) + dither->count * 3;
+}
+
+
+static inline uint8_t dither_channel(uint16_t value, uint8_t *residual) {
+    uint32_t v = value + *residual;
+    if (v > 0xffff)
+        v = 0xffff;
+
+    *residual = v & 0xff;
+    return v >> 8;
+}
+
+
+void ws2812_dither_frame(ws2812_dither_t *dither, const ws2812_color16_t *colors,
+                         ws2812_pixel_t *pixels) {
+    uint32_t start, end;
+    RSR(start, ccount);
+
+    uint8_t *residual = dither->residual;
+    uint32_t fraction = 0;
+
+    for (size_t i = 0; i < dither->count; i++) {
+        const ws2812_color16_t *color = &colors[i];
+        fraction |= color->red | color->green | color->blue;
+
+        pixels[i].red = dither_channel(color->red, residual++);
+        pixels[i].green = dither_channel(color->green, residual++);
+        pixels[i].blue = dither_channel(color->blue, residual++);
+        pixels[i].white = 0;
+    }
+
+    dither->pending = (fraction & 0xff) != 0;
+
+    RSR(end, ccount);
+    dither->frame_cycles = end - start;
+}
+
+
+void ws2812_dither_fill(ws2812_dither_t *dither, ws2812_color16_t color,
+                        ws2812_pixel_t *pixels) {
+    uint32_t start, end;
+    RSR(start, ccount);
+
+    uint8_t *residual = dither->residual;
+
+    for (size_t i = 0; i < dither->count; i++) {
+        pixels[i].red = dither_channel(color.red, residual++);
+        pixels[i].green = dither_channel(color.green, residual++);
+        pixels[i].blue = dither_channel(color.blue, residual++);
+        pixels[i].white = 0;
+    }
+
+    dither->pending = ((color.red | color.green | color.blue) & 0xff) != 0;
+
+    RSR(end, ccount);
+    dither->frame_cycles = end - start;
+}
+
+
+static inline uint16_t round_channel(uint16_t value) {
+    return (value >= 0xff80) ? 0xff00 : (value + 0x80) & 0xff00;
+}
+
+
+ws2812_color16_t ws2812_color16_round(ws2812_color16_t color) {
+    ws2812_color16_t rounded = {
+        round_channel(color.red), round_channel(color.green), round_channel(color.blue)
+    };
+    return rounded;
+}
+
+
+void ws2812_palette_expand(const ws2812_pixel_t *keys, size_t key_count,
+                           ws2812_color16_t *palette) {
+    for (size_t i = 0; i < WS2812_PALETTE_SIZE; i++) {
+        // Position between keys, integer part picks the keys
+        // and 8 bit fraction is the weight of the upper one
+        size_t position = i * key_count;
+        size_t key = position >> 8;
+        ws2812_pixel_t lo = keys[key];
+        ws2812_pixel_t hi = keys[(key + 1 < key_count) ? key + 1 : key];
+        uint16_t s2 = position & 0xff;
+        uint16_t s1 = 256 - s2;
+
+        palette[i].red = lo.red * s1 + hi.red * s2;
+        palette[i].green = lo.green * s1 + hi.green * s2;
+        palette[i].blue = lo.blue * s1 + hi.blue * s2;
+    }
+}
+
+
+void ws2812_output_init(ws2812_output_t *output, size_t count, pixeltype_t type) {
+    memset(output, 0, sizeof(*output));
+    output->count = count;
+    output->type = type;
+
+    // Every byte of pixel type is 2 bits on the wire, 1.25us each
+    output->frame_us = count * type * 5 / 2;
+}
+
+
+void ws2812_output_invalidate(ws2812_output_t *output) {
+    output->valid = false;
+}
+
+
+bool ws2812_output_update(ws2812_output_t *output, ws2812_pixel_t *pixels) {
+    // White is not sent to RGB strips, so it must not cause updates either
+    uint32_t mask = (output->type == PIXEL_RGB) ? 0x00ffffff : 0xffffffff;
+
+    // FNV-1a, one round per pixel instead of per byte
+    uint32_t hash = 0x811c9dc5;
+    for (size_t i = 0; i < output->count; i++)
+        hash = (hash ^ (pixels[i].color & mask)) * 0x01000193;
+
+    if (output->valid && hash == output->last_hash) {
+        output->frames_skipped++;
+        return false;
+    }
+
+    ws2812_i2s_update(pixels, output->type);
+
+    output->last_hash = hash;
+    output->valid = true;
+    output->frames_sent++;
+    return true;
+}
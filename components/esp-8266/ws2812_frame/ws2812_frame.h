@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <ws2812_i2s/ws2812_i2s.h>
+
+/**
+    Pixel color with 16 bit channels. The high byte is what an 8 bit
+    WS2812 channel can show, the low byte is the part that is dithered.
+*/
+typedef struct {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+} ws2812_color16_t;
+
+/**
+    Temporal dithering state. Each channel carries the part of its color
+    that the previous frames could not show over to the next frame, so that
+    averaged over a few frames the strip shows the full 16 bit color.
+*/
+typedef struct {
+    size_t count;
+    uint8_t *residual;          // 3 bytes per pixel
+
+    bool pending;               // last frame had a fractional part somewhere
+    uint32_t frame_cycles;      // CPU cycles spent on the last frame
+} ws2812_dither_t;
+
+/**
+    Allocates residual buffer for the given number of pixels.
+    Residuals are seeded with a spread pattern so that pixels of the same
+    color don't flip between adjacent values all at once.
+
+    @return A negative integer if this method fails.
+*/
+int ws2812_dither_init(ws2812_dither_t *dither, size_t count);
+
+/**
+    Frees the residual buffer.
+*/
+void ws2812_dither_done(ws2812_dither_t *dither);
+
+/**
+    RAM used by the dithering state, in bytes.
+*/
+size_t ws2812_dither_ram(const ws2812_dither_t *dither);
+
+/**
+    Renders next frame of 16 bit colors into 8 bit pixels.
+
+    A static picture with a fractional part has to be rendered again every
+    frame interval for as long as dither->pending is set.
+
+    @param colors Colors for dither->count pixels
+    @param pixels Buffer receiving dither->count pixels
+*/
+void ws2812_dither_frame(ws2812_dither_t *dither, const ws2812_color16_t *colors,
+                         ws2812_pixel_t *pixels);
+
+/**
+    Same as ws2812_dither_frame() with all pixels set to one color.
+*/
+void ws2812_dither_fill(ws2812_dither_t *dither, ws2812_color16_t color,
+                        ws2812_pixel_t *pixels);
+
+/**
+    Frames after which the dither pattern of a static color repeats.
+    Residuals are 8 bit, so every 16 bit color comes back to the same
+    residuals after at most 256 frames.
+*/
+#define WS2812_DITHER_CYCLE 256
+
+/**
+    Rounds a 16 bit color to the nearest color an 8 bit strip shows
+    without dithering. A static picture can be settled on it once it has
+    been dithered for long enough, so refreshing can stop.
+*/
+ws2812_color16_t ws2812_color16_round(ws2812_color16_t color);
+
+/**
+    Number of entries in an expanded palette, one per 8 bit index.
+*/
+#define WS2812_PALETTE_SIZE 256
+
+/**
+    Expands a palette of key colors spread evenly over the index range
+    into WS2812_PALETTE_SIZE colors, interpolating between the keys.
+    Effects can then map an 8 bit value to a color with one lookup.
+
+    @param keys Key colors, first is index 0
+    @param key_count Number of key colors, 2 to WS2812_PALETTE_SIZE
+    @param palette Buffer receiving WS2812_PALETTE_SIZE colors
+*/
+void ws2812_palette_expand(const ws2812_pixel_t *keys, size_t key_count,
+                           ws2812_color16_t *palette);
+
+/**
+    Output stage in front of ws2812_i2s_update() that skips frames identical
+    to the last one sent. Frames are compared by a 32 bit hash, so no copy
+    of the previous frame is kept.
+*/
+typedef struct {
+    size_t count;
+    pixeltype_t type;
+
+    uint32_t last_hash;
+    bool valid;                 // last_hash describes what the strip shows
+
+    uint32_t frame_us;          // bus time of one frame, in microseconds
+    uint32_t frames_sent;
+    uint32_t frames_skipped;
+} ws2812_output_t;
+
+/**
+    Initializes output stage for the given number of pixels.
+    Strip itself has to be initialized with ws2812_i2s_init().
+*/
+void ws2812_output_init(ws2812_output_t *output, size_t count, pixeltype_t type);
+
+/**
+    Makes next ws2812_output_update() send its frame no matter what,
+    e.g. after the strip was written to bypassing the output stage.
+*/
+void ws2812_output_invalidate(ws2812_output_t *output);
+
+/**
+    Sends pixels to the strip unless they are the same as the last frame.
+
+    @return true if the frame was sent, false if it was skipped
+*/
+bool ws2812_output_update(ws2812_output_t *output, ws2812_pixel_t *pixels);
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <espressif/esp_wifi.h>
 #include <espressif/esp_sta.h>
+#include <espressif/esp_common.h>
 #include <esp/uart.h>
 #include <esp8266.h>
 #include <FreeRTOS.h>
@@ -20,9 +21,10 @@
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <color.h>
+#include <write_batch.h>
 #include "wifi.h"
 
-#include <math.h>  //requires LIBS ?= hal m to be added to Makefile
 #include "mjpwm.h"
 
 
@@ -37,60 +39,50 @@ static void wifi_init() {
     sdk_wifi_station_connect();
 }
 
-//http://blog.saikoled.com/post/44677718712/how-to-convert-from-hsi-to-rgb-white
 void hsi2rgbw(float h, float s, float i, int* rgbw) {
-    int r, g, b, w;
-    float cos_h, cos_1047_h;
-    //h = fmod(h,360); // cycle h around to 0-360 degrees
-    h = 3.14159*h/(float)180; // Convert to radians.
-    s /=(float)100; i/=(float)100; //from percentage to ratio
-    s = s>0?(s<1?s:1):0; // clamp s and i to interval [0,1]
-    i = i>0?(i<1?i:1):0;
-    i = i*sqrt(i); //shape intensity to have finer granularity near 0
-
-    if(h < 2.09439) {
-        cos_h = cos(h);
-        cos_1047_h = cos(1.047196667-h);
-        r = s*4095*i/3*(1+cos_h/cos_1047_h);
-        g = s*4095*i/3*(1+(1-cos_h/cos_1047_h));
-        b = 0;
-        w = 4095*(1-s)*i;
-    } else if(h < 4.188787) {
-        h = h - 2.09439;
-        cos_h = cos(h);
-        cos_1047_h = cos(1.047196667-h);
-        g = s*4095*i/3*(1+cos_h/cos_1047_h);
-        b = s*4095*i/3*(1+(1-cos_h/cos_1047_h));
-        r = 0;
-        w = 4095*(1-s)*i;
-    } else {
-        h = h - 4.188787;
-        cos_h = cos(h);
-        cos_1047_h = cos(1.047196667-h);
-        b = s*4095*i/3*(1+cos_h/cos_1047_h);
-        r = s*4095*i/3*(1+(1-cos_h/cos_1047_h));
-        g = 0;
-        w = 4095*(1-s)*i;
-    }
+    color_rgbw_t color;
+    color_hsi2rgbw(color_hue(h), color_percent(s),
+                   color_intensity_perceptual(color_percent(i)), 4095, &color);
 
-    rgbw[0]=r;
-    rgbw[1]=g;
-    rgbw[2]=b;
-    rgbw[3]=w;
+    rgbw[0]=color.red;
+    rgbw[1]=color.green;
+    rgbw[2]=color.blue;
+    rgbw[3]=color.white;
 }
 
 #define PIN_DI 				13
 #define PIN_DCKI 			15
+#define WHITE_MIRED 		160     // cold white LEDs, about 6250 K
 
 float hue,sat,bri;
 bool on;
+uint16_t ct = WHITE_MIRED;
+bool ct_mode = false;   // last color came as color temperature, not hue/saturation
+
+// RGBW mix for each color temperature, filled once at start
+color_white_t white_mix;
+
+// Setters only store values, one controller write sends duty once
+write_batch_t light_batch;
+volatile bool light_identify_requested = false;
 
 void lightSET(void) {
     int rgbw[4];
     if (on) {
-        printf("h=%d,s=%d,b=%d => ",(int)hue,(int)sat,(int)bri);
-        
-        hsi2rgbw(hue,sat,bri,rgbw);
+        if (ct_mode) {
+            printf("ct=%d,b=%d => ",ct,(int)bri);
+
+            color_rgbw_t color;
+            color_mired2rgbw(&white_mix, ct, color_intensity_perceptual(color_percent(bri)), 4095, &color);
+            rgbw[0]=color.red;
+            rgbw[1]=color.green;
+            rgbw[2]=color.blue;
+            rgbw[3]=color.white;
+        } else {
+            printf("h=%d,s=%d,b=%d => ",(int)hue,(int)sat,(int)bri);
+
+            hsi2rgbw(hue,sat,bri,rgbw);
+        }
         printf("r=%d,g=%d,b=%d,w=%d\n",rgbw[0],rgbw[1],rgbw[2],rgbw[3]);
         
         mjpwm_send_duty(rgbw[0],rgbw[1],rgbw[2],rgbw[3]);
@@ -100,6 +92,33 @@ void lightSET(void) {
     }
 }
 
+void light_identify_show(void) {
+    for (int i=0;i<5;i++) {
+        mjpwm_send_duty(4095,    0,    0,    0);
+        vTaskDelay(300 / portTICK_PERIOD_MS); //0.3 sec
+        mjpwm_send_duty(   0, 4095,    0,    0);
+        vTaskDelay(300 / portTICK_PERIOD_MS); //0.3 sec
+        mjpwm_send_duty(   0,    0, 4095,    0);
+        vTaskDelay(300 / portTICK_PERIOD_MS); //0.3 sec
+    }
+}
+
+// Runs on the batch task, the only one that sends duty after init
+void light_apply(void *_context) {
+    // Writes during identify are batched and applied right after it
+    if (light_identify_requested) {
+        light_identify_requested = false;
+        light_identify_show();
+    }
+    lightSET();
+
+    const mjpwm_stats_t *stats = mjpwm_get_stats();
+    uint8_t mhz = sdk_system_get_cpu_freq();
+    printf("writes %u, updates %u, sent %u, unchanged %u, interrupts off %u us (max %u)\n",
+           light_batch.writes, light_batch.applies, stats->transfers, stats->skipped,
+           stats->critical_cycles / mhz, stats->critical_max_cycles / mhz);
+}
+
 void light_init() {
     mjpwm_cmd_t init_cmd = {
         .scatter = MJPWM_CMD_SCATTER_APDM,
@@ -110,6 +129,8 @@ void light_init() {
         .resv = 0,
     };
     mjpwm_init(PIN_DI, PIN_DCKI, 1, init_cmd);
+    color_white_init(&white_mix, WHITE_MIRED);
+    write_batch_init(&light_batch, "Light", 256, light_apply, NULL);
     on=true; hue=0; sat=0; bri=100; //this should not be here, but part of the homekit init work
     lightSET();
 }
@@ -123,7 +144,7 @@ void light_on_set(homekit_value_t value) {
         return;
     }
     on = value.bool_value;
-    lightSET();
+    write_batch_touch(&light_batch);
 }
 
 homekit_value_t light_bri_get() {
@@ -135,7 +156,7 @@ void light_bri_set(homekit_value_t value) {
         return;
     }
     bri = value.int_value;
-    lightSET();
+    write_batch_touch(&light_batch);
 }
 
 homekit_value_t light_hue_get() {
@@ -147,7 +168,8 @@ void light_hue_set(homekit_value_t value) {
         return;
     }
     hue = value.float_value;
-    lightSET();
+    ct_mode = false;
+    write_batch_touch(&light_batch);
 }
 
 homekit_value_t light_sat_get() {
@@ -159,27 +181,28 @@ void light_sat_set(homekit_value_t value) {
         return;
     }
     sat = value.float_value;
-    lightSET();
+    ct_mode = false;
+    write_batch_touch(&light_batch);
 }
 
-
-void light_identify_task(void *_args) {
-    for (int i=0;i<5;i++) {
-        mjpwm_send_duty(4095,    0,    0,    0);
-        vTaskDelay(300 / portTICK_PERIOD_MS); //0.3 sec
-        mjpwm_send_duty(   0, 4095,    0,    0);
-        vTaskDelay(300 / portTICK_PERIOD_MS); //0.3 sec
-        mjpwm_send_duty(   0,    0, 4095,    0);
-        vTaskDelay(300 / portTICK_PERIOD_MS); //0.3 sec
+homekit_value_t light_ct_get() {
+    return HOMEKIT_UINT32(ct);
+}
+void light_ct_set(homekit_value_t value) {
+    if (value.format != homekit_format_uint32) {
+        printf("Invalid ct-value format: %d\n", value.format);
+        return;
     }
-    lightSET();
-
-    vTaskDelete(NULL);
+    ct = value.uint32_value;
+    ct_mode = true;
+    write_batch_touch(&light_batch);
 }
 
+
 void light_identify(homekit_value_t _value) {
     printf("Light Identify\n");
-    xTaskCreate(light_identify_task, "Light identify", 256, NULL, 2, NULL);
+    light_identify_requested = true;
+    write_batch_touch(&light_batch);
 }
 
 
@@ -220,6 +243,13 @@ homekit_accessory_t *accessories[] = {
                         .getter=light_sat_get,
                         .setter=light_sat_set
                     ),
+                    HOMEKIT_CHARACTERISTIC(
+                        COLOR_TEMPERATURE, WHITE_MIRED,
+                        .getter=light_ct_get,
+                        .setter=light_ct_set,
+                        .min_value=(float[]) {COLOR_MIRED_MIN},
+                        .max_value=(float[]) {COLOR_MIRED_MAX}
+                    ),
                     NULL
                 }),
             NULL
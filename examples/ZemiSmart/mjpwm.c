@@ -11,45 +11,82 @@
  *     2017/12/24, adapted for esp-open-rtos
 *******************************************************************************/
 #include "mjpwm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
 #include <espressif/esp_misc.h>  //defines sdk_os_delay_us
 #include <task.h>
+#include <semphr.h>
 #include <esp/gpio.h>
+#include <xtensa_ops.h>
 
 #define GPIO_MAX_INDEX 16
 
-#ifndef LOW
-#define LOW                             (0)
-#endif              /* ifndef LOW */
+// Bits of one chip: 4 channels of up to 16 bits
+#define MJPWM_CHIP_BITS (MJPWM_CHANNELS * 16)
 
-#ifndef HIGH
-#define HIGH                            (1)
-#endif              /* ifndef HIGH */
-
-//#define MJPWM_DIRECT_GPIO(pin)        PIN_FUNC_SELECT(pin_name[pin], pin_func[pin])
-#define MJPWM_DIRECT_GPIO(pin)          gpio_enable(pin,GPIO_OUTPUT)
-////#define MJPWM_DIRECT_READ(pin)      (0x01 & GPIO_INPUT_GET(GPIO_ID_PIN(pin)))
-////#define MJPWM_DIRECT_MODE_INPUT(pin)    (GPIO_DIS_OUTPUT(GPIO_ID_PIN(pin)))
-#define MJPWM_DIRECT_MODE_OUTPUT(pin)
-//#define MJPWM_DIRECT_WRITE_LOW(pin)   (GPIO_OUTPUT_SET(GPIO_ID_PIN(pin), LOW))
-#define MJPWM_DIRECT_WRITE_LOW(pin)     gpio_write(pin,0)
-//#define MJPWM_DIRECT_WRITE_HIGH(pin)  (GPIO_OUTPUT_SET(GPIO_ID_PIN(pin), HIGH))
-#define MJPWM_DIRECT_WRITE_HIGH(pin)    gpio_write(pin,1)
+// Setup and hold time around DCKI edges
+#define MJPWM_DELAY()                   asm volatile ("nop;")
 
 
 static int nc = 2;
 
 static uint8_t pin_di = 13;
 static uint8_t pin_dcki = 15;
+static uint32_t di_mask = BIT(13);
+static uint32_t dcki_mask = BIT(15);
 
 static mjpwm_cmd_t mjpwm_commands[GPIO_MAX_INDEX + 1];
 
+// Bit stream of a transfer, packed MSB first
+static uint32_t *mjpwm_bits = NULL;
+
+// Duties the chips were last sent, so unchanged frames can be skipped
+static uint16_t *mjpwm_sent = NULL;
+static bool mjpwm_sent_valid = false;
+
+static mjpwm_stats_t mjpwm_stats;
+
+// Held for a whole transfer: bit stream, pin phases, sent cache and stats
+static SemaphoreHandle_t mjpwm_lock = NULL;
+
+
+static uint16_t mjpwm_bit_length(void)
+{
+    switch (mjpwm_commands[pin_dcki].bit_width) {
+    case MJPWM_CMD_BIT_WIDTH_16:
+        return 16;
+    case MJPWM_CMD_BIT_WIDTH_14:
+        return 14;
+    case MJPWM_CMD_BIT_WIDTH_12:
+        return 12;
+    default:
+        return 8;
+    }
+}
+
+// Appends low `length` bits of value to the bit stream
+static void mjpwm_put_bits(uint16_t *count, uint32_t value, uint8_t length)
+{
+    while (length--) {
+        uint32_t *word = &mjpwm_bits[*count >> 5];
+        uint32_t bit = 0x80000000 >> (*count & 31);
+
+        if (value & (1 << length))
+            *word |= bit;
+        else
+            *word &= ~bit;
+        (*count)++;
+    }
+}
+
 IRAM void mjpwm_di_pulse(uint16_t times)
 {
     uint16_t i;
     for (i = 0; i < times; i++) {
-        MJPWM_DIRECT_WRITE_HIGH(pin_di);
+        GPIO.OUT_SET = di_mask;
         asm("nop;");    // delay 50ns
-        MJPWM_DIRECT_WRITE_LOW(pin_di);
+        GPIO.OUT_CLEAR = di_mask;
         asm("nop;nop;nop;nop;nop;");
         // delay 230ns
     }
@@ -59,173 +96,205 @@ void mjpwm_dcki_pulse(uint16_t times)
 {
     uint16_t i;
     for (i = 0; i < times; i++) {
-        MJPWM_DIRECT_WRITE_HIGH(pin_dcki);
+        GPIO.OUT_SET = dcki_mask;
         asm("nop;");        // delay 50ns
-        MJPWM_DIRECT_WRITE_LOW(pin_dcki);
+        GPIO.OUT_CLEAR = dcki_mask;
         asm("nop;");        // delay 50ns
     }
 }
 
+// Clocks out the bit stream, one bit on each DCKI edge. Only whole
+// GPIO.OUT words are stored, prepared from the bits without branching.
+static IRAM void mjpwm_clock_out(uint16_t count)
+{
+    const uint32_t *bits = mjpwm_bits;
+    uint32_t base = GPIO.OUT & ~(di_mask | dcki_mask);
+    uint32_t word = 0;
+
+    for (uint16_t i = 0; i < count; i += 2) {
+        if (!(i & 31))
+            word = *bits++;
+
+        // DI = bit, DCK = 1, DI = next bit, DCK = 0
+        uint32_t rising = base | (-(word >> 31) & di_mask);
+        uint32_t falling = base | (-((word >> 30) & 1) & di_mask);
+        word <<= 2;
+
+        GPIO.OUT = rising;
+        GPIO.OUT = rising | dcki_mask;
+        MJPWM_DELAY();
+        GPIO.OUT = falling | dcki_mask;
+        GPIO.OUT = falling;
+        MJPWM_DELAY();
+    }
+
+    GPIO.OUT = base;
+}
+
+// Interrupts are only blocked while pins toggle, delays between
+// phases are minimum times and may be stretched by interrupts
+#define MJPWM_CRITICAL(code) \
+    do { \
+        uint32_t start, end; \
+        taskENTER_CRITICAL(); \
+        RSR(start, ccount); \
+        code; \
+        RSR(end, ccount); \
+        taskEXIT_CRITICAL(); \
+        if (end - start > longest) \
+            longest = end - start; \
+    } while (0)
+
+static void mjpwm_transfer_done(uint32_t longest)
+{
+    mjpwm_stats.transfers++;
+    mjpwm_stats.critical_cycles = longest;
+    if (longest > mjpwm_stats.critical_max_cycles)
+        mjpwm_stats.critical_max_cycles = longest;
+}
+
 void mjpwm_send_command(mjpwm_cmd_t command)
 {
-    uint8_t i, n;
-    uint8_t command_data;
+    uint8_t n;
+    uint16_t count = 0;
+    uint32_t longest = 0;
+
+    if (!mjpwm_bits)
+        return;
+
+    xSemaphoreTake(mjpwm_lock, portMAX_DELAY);
     mjpwm_commands[pin_dcki] = command;
 
-    taskENTER_CRITICAL(); //ets_intr_lock();
+    for (n = 0; n < nc; n++)
+        mjpwm_put_bits(&count, *(uint8_t *) (&command), 8);
+
     // TStop > 12us.
     sdk_os_delay_us(12);
     // Send 12 DI pulse, after 6 pulse's falling edge store duty data, and 12
     // pulse's rising edge convert to command mode.
-    mjpwm_di_pulse(12);
+    MJPWM_CRITICAL(mjpwm_di_pulse(12));
     // Delay >12us, begin send CMD data
     sdk_os_delay_us(12);
-    asm("nop;nop;");
     // Send CMD data
-
-    for (n = 0; n < nc; n++) {
-
-        command_data = *(uint8_t *) (&command);
-
-        for (i = 0; i < 4; i++) {
-            // DCK = 0;
-            MJPWM_DIRECT_WRITE_LOW(pin_dcki);
-            if (command_data & 0x80) {
-                // DI = 1;
-                MJPWM_DIRECT_WRITE_HIGH(pin_di);
-            } else {
-                // DI = 0;
-                MJPWM_DIRECT_WRITE_LOW(pin_di);
-            }
-            // DCK = 1;
-            MJPWM_DIRECT_WRITE_HIGH(pin_dcki);
-            command_data = command_data << 1;
-            if (command_data & 0x80) {
-                // DI = 1;
-                MJPWM_DIRECT_WRITE_HIGH(pin_di);
-            } else {
-                // DI = 0;
-                MJPWM_DIRECT_WRITE_LOW(pin_di);
-            }
-            // DCK = 0;
-            MJPWM_DIRECT_WRITE_LOW(pin_dcki);
-            // DI = 0;
-            MJPWM_DIRECT_WRITE_LOW(pin_di);
-            command_data = command_data << 1;
-        }
-
-        asm("nop;nop;nop;");
-    }
-
+    MJPWM_CRITICAL(mjpwm_clock_out(count));
     // TStart > 12us. Delay 12 us.
     sdk_os_delay_us(12);
     // Send 16 DI pulse，at 14 pulse's falling edge store CMD data, and
     // at 16 pulse's falling edge convert to duty mode.
-    mjpwm_di_pulse(16);
+    MJPWM_CRITICAL(mjpwm_di_pulse(16));
     // TStop > 12us.
     sdk_os_delay_us(12);
-    asm("nop;nop;");
-    taskEXIT_CRITICAL(); //ets_intr_unlock();
+
+    // Chips may read data sent with another bit width differently
+    mjpwm_sent_valid = false;
+
+    mjpwm_transfer_done(longest);
+    xSemaphoreGive(mjpwm_lock);
 }
 
-IRAM void mjpwm_send_duty(uint16_t duty_r, uint16_t duty_g,
-        uint16_t duty_b, uint16_t duty_w)
+bool mjpwm_send_duties(const uint16_t *duties)
 {
-    uint8_t i = 0, n;
-    uint8_t channel = 0;
-    uint8_t bit_length = 8;
-    uint16_t duty_current = 0;
+    uint16_t i;
+    uint16_t count = 0;
+    uint32_t longest = 0;
 
-    // Definition for RGBW channels
-    uint16_t duty[4] = { duty_r, duty_g, duty_b, duty_w };
+    if (!mjpwm_bits)
+        return false;
 
-    switch (mjpwm_commands[pin_dcki].bit_width) {
-    case MJPWM_CMD_BIT_WIDTH_16:
-        bit_length = 16;
-        break;
-    case MJPWM_CMD_BIT_WIDTH_14:
-        bit_length = 14;
-        break;
-    case MJPWM_CMD_BIT_WIDTH_12:
-        bit_length = 12;
-        break;
-    case MJPWM_CMD_BIT_WIDTH_8:
-        bit_length = 8;
-        break;
-    default:
-        bit_length = 8;
-        break;
+    xSemaphoreTake(mjpwm_lock, portMAX_DELAY);
+    uint8_t bit_length = mjpwm_bit_length();
+
+    if (mjpwm_sent_valid && !memcmp(duties, mjpwm_sent, nc * MJPWM_CHANNELS * sizeof(*duties))) {
+        mjpwm_stats.skipped++;
+        xSemaphoreGive(mjpwm_lock);
+        return false;
     }
 
-    taskENTER_CRITICAL(); //ets_intr_lock();
+    for (i = 0; i < nc * MJPWM_CHANNELS; i++)
+        mjpwm_put_bits(&count, duties[i], bit_length);
+
     // TStop > 12us.
     sdk_os_delay_us(12);
-    asm("nop;nop;");
-
-    for (n = 0; n < nc; n++)
-    {
-        for (channel = 0; channel < 4; channel++)   //RGBW 4CH
-        {
-            // RGBW Channel
-            duty_current = duty[channel];
-            // Send 8bit/12bit/14bit/16bit Data
-            for (i = 0; i < bit_length / 2; i++) {
-
-                // DCK = 0;
-                MJPWM_DIRECT_WRITE_LOW(pin_dcki);
-                if (duty_current & (0x01 << (bit_length - 1))) {
-                    // DI = 1;
-                    MJPWM_DIRECT_WRITE_HIGH(pin_di);
-                } else {
-                    // DI = 0;
-                    MJPWM_DIRECT_WRITE_LOW(pin_di);
-                }
-
-                // DCK = 1;
-                MJPWM_DIRECT_WRITE_HIGH(pin_dcki);
-                duty_current = duty_current << 1;
-                if (duty_current & (0x01 << (bit_length - 1))) {
-                    // DI = 1;
-                    MJPWM_DIRECT_WRITE_HIGH(pin_di);
-                } else {
-                    // DI = 0;
-                    MJPWM_DIRECT_WRITE_LOW(pin_di);
-                }
-
-                //DCK = 0;
-                MJPWM_DIRECT_WRITE_LOW(pin_dcki);
-                //DI = 0;
-                MJPWM_DIRECT_WRITE_LOW(pin_di);
-
-                duty_current = duty_current << 1;
-            }
-        }
-    }
-
+    // Send 8bit/12bit/14bit/16bit Data
+    MJPWM_CRITICAL(mjpwm_clock_out(count));
     // TStart > 12us. Ready for send DI pulse.
     sdk_os_delay_us(12);
     // Send 8 DI pulse. After 8 pulse falling edge, store old data.
-    mjpwm_di_pulse(8);
+    MJPWM_CRITICAL(mjpwm_di_pulse(8));
     // TStop > 12us.
     sdk_os_delay_us(12);
-    asm("nop;nop;");
-    taskEXIT_CRITICAL(); //ets_intr_unlock();
+
+    memcpy(mjpwm_sent, duties, nc * MJPWM_CHANNELS * sizeof(*duties));
+    mjpwm_sent_valid = true;
+
+    mjpwm_transfer_done(longest);
+    xSemaphoreGive(mjpwm_lock);
+    return true;
+}
+
+bool mjpwm_send_duty(uint16_t duty_r, uint16_t duty_g,
+        uint16_t duty_b, uint16_t duty_w)
+{
+    uint16_t duties[nc * MJPWM_CHANNELS];
+    uint8_t n;
+
+    // Same RGBW duty on every chip
+    for (n = 0; n < nc; n++) {
+        duties[n * MJPWM_CHANNELS + 0] = duty_r;
+        duties[n * MJPWM_CHANNELS + 1] = duty_g;
+        duties[n * MJPWM_CHANNELS + 2] = duty_b;
+        duties[n * MJPWM_CHANNELS + 3] = duty_w;
+    }
+
+    return mjpwm_send_duties(duties);
+}
+
+void mjpwm_invalidate(void)
+{
+    if (!mjpwm_bits)
+        return;
+
+    // Not lost to a transfer in progress marking the cache valid
+    xSemaphoreTake(mjpwm_lock, portMAX_DELAY);
+    mjpwm_sent_valid = false;
+    xSemaphoreGive(mjpwm_lock);
+}
+
+const mjpwm_stats_t *mjpwm_get_stats(void)
+{
+    return &mjpwm_stats;
 }
 
 void mjpwm_init(uint8_t di, uint8_t dcki, uint8_t n_chips, mjpwm_cmd_t cmd)
 {
     pin_di = di;
     pin_dcki = dcki;
+    di_mask = BIT(di);
+    dcki_mask = BIT(dcki);
 
-    MJPWM_DIRECT_GPIO(pin_di);
-    MJPWM_DIRECT_GPIO(pin_dcki);
-    MJPWM_DIRECT_MODE_OUTPUT(pin_di);
-    MJPWM_DIRECT_MODE_OUTPUT(pin_dcki);
-    MJPWM_DIRECT_WRITE_LOW(pin_di);
-    MJPWM_DIRECT_WRITE_LOW(pin_dcki);
+    gpio_enable(pin_di, GPIO_OUTPUT);
+    gpio_enable(pin_dcki, GPIO_OUTPUT);
+    GPIO.OUT_CLEAR = di_mask | dcki_mask;
 
     nc = n_chips;
 
+    if (!mjpwm_lock)
+        mjpwm_lock = xSemaphoreCreateMutex();
+
+    free(mjpwm_bits);
+    free(mjpwm_sent);
+    mjpwm_bits = calloc((nc * MJPWM_CHIP_BITS + 31) / 32, sizeof(uint32_t));
+    mjpwm_sent = calloc(nc * MJPWM_CHANNELS, sizeof(uint16_t));
+    mjpwm_sent_valid = false;
+    if (!mjpwm_lock || !mjpwm_bits || !mjpwm_sent) {
+        printf("Failed to allocate MJPWM buffers for %d chips\n", nc);
+        free(mjpwm_bits);
+        free(mjpwm_sent);
+        mjpwm_bits = NULL;
+        mjpwm_sent = NULL;
+        return;
+    }
+
     // Clear all duty register
     mjpwm_dcki_pulse(32 * nc);
 
@@ -16,6 +16,7 @@ Motorized blinds.  Crude approach simply constant time to open or close a blind.
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <input_dispatch.h>
 #include "wifi.h"
 
 #define POSITION_STATIONARY 0
@@ -140,6 +141,8 @@ void main_task(void *_args)
 	gpio_enable(remote_right_close, GPIO_INPUT);
 	gpio_enable(remote_right_open, GPIO_INPUT);
 	
+	const uint32_t remote_mask = BIT(remote_left_close) | BIT(remote_left_open) |
+		BIT(remote_right_close) | BIT(remote_right_open);
 	
 	while(1) 
 	{
@@ -250,9 +253,12 @@ void main_task(void *_args)
 		}
 
 
+		// all remote inputs in one read
+		uint32_t remote = input_dispatch_read(remote_mask);
+
 		//if(gpio_read(remote_valid))	// valid input from remote - not enough inputs!
 		//{
-			if( gpio_read(remote_left_close) )
+			if( remote & BIT(remote_left_close) )
 			{
 				if( target_position_left.value.int_value > target_position_left.min_value[0] )
 				{
@@ -269,7 +275,7 @@ void main_task(void *_args)
 					gpio_write(left_blind_close, true);
 				}
 			}
-			else if( gpio_read(remote_left_open) )
+			else if( remote & BIT(remote_left_open) )
 			{
 				if( target_position_left.value.int_value < target_position_left.max_value[0] )
 				{
@@ -286,7 +292,7 @@ void main_task(void *_args)
 					gpio_write(left_blind_close, false);
 				}
 			}
-			if( gpio_read(remote_right_close) )
+			if( remote & BIT(remote_right_close) )
 			{					
 				if( target_position_right.value.int_value > target_position_right.min_value[0] )
 				{
@@ -303,7 +309,7 @@ void main_task(void *_args)
 					gpio_write(right_blind_close, true);
 				}
 			}
-			else if( gpio_read(remote_right_open) )
+			else if( remote & BIT(remote_right_open) )
 			{
 				if( target_position_right.value.int_value < target_position_right.max_value[0] )
 				{
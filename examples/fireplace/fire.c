@@ -0,0 +1,78 @@
+#include "fire.h"
+
+#include <esp/hwrand.h>
+
+#define NUM_CELLS (FIRE_WIDTH*FIRE_HEIGHT)
+
+// Heat of fire cells, two 16 bit cells are cooled at once
+static union {
+    uint16_t cells[FIRE_WIDTH][FIRE_HEIGHT];
+    uint32_t pairs[NUM_CELLS / 2];
+} heat;
+
+static uint32_t random_bits;
+static uint8_t random_count;
+
+static uint8_t random8() {
+    // hwrand() gives 32 random bits, use them for four cells
+    if (!random_count) {
+        random_bits = hwrand();
+        random_count = 4;
+    } else {
+        random_bits >>= 8;
+    }
+    random_count--;
+
+    return random_bits;
+}
+
+static inline uint16_t cooling() {
+    return (random8() * FIRE_COOLING) >> 8;
+}
+
+// Subtracts both 16 bit lanes of b from a, stopping at 0. Lanes are
+// below 0x8000, so the top bit of each lane catches the borrow.
+static inline uint32_t sub_pairs(uint32_t a, uint32_t b) {
+    uint32_t d = (a | 0x80008000) - b;
+    uint32_t keep = d & 0x80008000;
+    return d & (keep - (keep >> 15));
+}
+
+void fire_update(unsigned int hot) {
+    unsigned int maxhot = hot * FIRE_HEIGHT;
+
+    // 1. Cool all the sparks
+    for (int i = 0; i < NUM_CELLS / 2; i++) {
+        heat.pairs[i] = sub_pairs(heat.pairs[i], cooling() | (cooling() << 16));
+    }
+    if (NUM_CELLS % 2) {
+        uint16_t *last = &heat.cells[FIRE_WIDTH-1][FIRE_HEIGHT-1];
+        uint16_t c = cooling();
+        *last = (*last < c) ? 0 : *last - c;
+    }
+
+    for (int i = 0; i < FIRE_WIDTH; i++) {
+        if (heat.cells[i][0] < hot) {
+            uint16_t r = (random8() << 8) | random8();
+            heat.cells[i][0] = hot + ((r * (maxhot - hot)) >> 16);
+        }
+    }
+
+    // 2. Heat drifts up and spreads a little
+    for (int i = 0; i < FIRE_WIDTH; i++) {
+        uint16_t *column = heat.cells[i];
+        for (int j = FIRE_HEIGHT-1; j > 0; j--) {
+            uint32_t sum = column[j] + column[j-1];
+            if (i > 0)
+                sum += heat.cells[i-1][j-1];
+            if (i < FIRE_WIDTH-1)
+                sum += heat.cells[i+1][j-1];
+
+            column[j] = (sum * FIRE_SPREAD_DIV) >> FIRE_SPREAD_DIV_SHIFT;
+        }
+    }
+}
+
+uint8_t fire_palette_index(int x, int y) {
+    return ((heat.cells[x][y] * FIRE_HEAT_DIV) >> FIRE_HEAT_DIV_SHIFT) * 2;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Board shape and size configuration. Sheild is 6x10, 60 pixels.
+   Fire rises along the height. */
+#ifndef FIRE_WIDTH
+#define FIRE_WIDTH 6
+#endif
+
+#ifndef FIRE_HEIGHT
+#define FIRE_HEIGHT 10
+#endif
+
+/* Rate of cooling. Play with to change fire from
+   roaring (larger values) to weak (smaller values) */
+#ifndef FIRE_COOLING
+#define FIRE_COOLING 55
+#endif
+
+/* Heat of a cell stays below 256*FIRE_HEIGHT, sum of four cells below
+   1024*FIRE_HEIGHT. Fixed point divisions below are exact in that range. */
+#if FIRE_HEIGHT > 32
+#error "Fire simulation supports up to 32 rows"
+#endif
+
+// x / FIRE_HEIGHT for x < 256*FIRE_HEIGHT
+#define FIRE_HEAT_DIV_SHIFT 22
+#define FIRE_HEAT_DIV ((1u << FIRE_HEAT_DIV_SHIFT) / FIRE_HEIGHT + 1)
+
+// x / 6 for x < 32768
+#define FIRE_SPREAD_DIV_SHIFT 17
+#define FIRE_SPREAD_DIV 21846u
+
+/**
+ * Advances the fire by one frame
+ * @param hot Heat of a freshly lit bottom cell, 0..256
+ */
+void fire_update(unsigned int hot);
+
+/**
+ * Heat of a cell as a palette index
+ * @param x Column
+ * @param y Row, 0 is the bottom where fire is lit
+ */
+uint8_t fire_palette_index(int x, int y);
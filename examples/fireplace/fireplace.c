@@ -30,8 +30,12 @@
 #include <homekit/characteristics.h>
 
 #include <ws2812_i2s/ws2812_i2s.h>
+#include <ws2812_frame.h>
+#include <led_matrix.h>
+#include <animation.h>
 
 #include "wifi.h"
+#include "fire.h"
 
 static void wifi_init() {
     struct sdk_station_config wifi_config = {
@@ -47,22 +51,38 @@ static void wifi_init() {
 homekit_characteristic_t brightness = HOMEKIT_CHARACTERISTIC_(BRIGHTNESS, 50);
 
 
-/* Board shape and size configuration. Sheild is 6x10, 60 pixels */
-#define HEIGHT 10
-#define WIDTH 6
+/* Board shape and size configuration is in fire.h */
+#define HEIGHT FIRE_HEIGHT
+#define WIDTH FIRE_WIDTH
 #define NUM_LEDS (HEIGHT*WIDTH)
 
+/* Strip runs up the first column, down the second and so on.
+   Fire rises along y, from y=0 where the strip starts. */
+const led_matrix_layout_t matrix_layout = {
+    .panel_width = WIDTH,
+    .panel_height = HEIGHT,
+    .order = LED_MATRIX_COLUMNS,
+    .serpentine = true,
+};
+
 /* Refresh rate. Higher makes for flickerier
    Recommend small values for small displays */
 #define FPS 17
-#define FPS_DELAY (1000 / FPS / portTICK_PERIOD_MS)
 
-/* Rate of cooling. Play with to change fire from
-   roaring (larger values) to weak (smaller values) */
-#define COOLING 55
+/* Identify sweeps a column across the board every 100ms */
+#define IDENTIFY_FPS 10
 
 
-ws2812_pixel_t heat_colors[16] = {
+/* Heat palettes. Key colors are spread evenly from cold to hot
+   and expanded to a 256 color table when selected. */
+typedef enum {
+    PALETTE_FIRE = 0,
+    PALETTE_ICE,
+    PALETTE_AURORA,
+    PALETTE_COUNT
+} palette_id_t;
+
+const ws2812_pixel_t fire_colors[16] = {
     { .color=0x000000 },
     { .color=0x330000 },
     { .color=0x660000 },
@@ -81,162 +101,214 @@ ws2812_pixel_t heat_colors[16] = {
     { .color=0xffffff },
 };
 
-static int min(int a, int b) {
-    return (a > b) ? b : a;
-}
+const ws2812_pixel_t ice_colors[8] = {
+    { .color=0x000000 },
+    { .color=0x000033 },
+    { .color=0x000066 },
+    { .color=0x000099 },
+    { .color=0x0033cc },
+    { .color=0x0066ff },
+    { .color=0x33ccff },
+    { .color=0xffffff },
+};
+
+const ws2812_pixel_t aurora_colors[8] = {
+    { .color=0x000000 },
+    { .color=0x001a0d },
+    { .color=0x00331a },
+    { .color=0x006633 },
+    { .color=0x00cc66 },
+    { .color=0x33ff99 },
+    { .color=0x9966ff },
+    { .color=0xff99ff },
+};
+
+const struct {
+    const ws2812_pixel_t *keys;
+    size_t count;
+} palettes[PALETTE_COUNT] = {
+    [PALETTE_FIRE] = { fire_colors, sizeof(fire_colors) / sizeof(*fire_colors) },
+    [PALETTE_ICE] = { ice_colors, sizeof(ice_colors) / sizeof(*ice_colors) },
+    [PALETTE_AURORA] = { aurora_colors, sizeof(aurora_colors) / sizeof(*aurora_colors) },
+};
 
-uint8_t scale(uint8_t x, uint8_t s) {
-    return (((uint16_t)x) * s) >> 8;
+ws2812_color16_t heat_palette[WS2812_PALETTE_SIZE];
+
+static int max(int a, int b) {
+    return (a > b) ? a : b;
 }
 
-ws2812_pixel_t heat_color(uint8_t index) {
-    // Since palette is only 16 colors, uses high 4 bits if index
-    // to pick to palette colors and lower 4 bits to interpolate
-    // between those two colors.
-    ws2812_pixel_t lo_color = heat_colors[index >> 4];
-    if (!(index & 0xf))
-        return lo_color;
-
-    ws2812_pixel_t hi_color = heat_colors[min((index >> 4) + 1, 15)];
-    uint8_t s2 = (index & 0xf) << 4;
-    uint8_t s1 = 255 - s2;
-
-    return (ws2812_pixel_t) {
-        .red = scale(lo_color.red, s1) + scale(hi_color.red, s2),
-        .green = scale(lo_color.green, s1) + scale(hi_color.green, s2),
-        .blue = scale(lo_color.blue, s1) + scale(hi_color.blue, s2),
-    };
+void fireplace_set_palette(palette_id_t palette) {
+    // Expanding takes well under a frame time; a frame rendered
+    // while it is in progress just mixes two palettes for a moment
+    if (palette >= PALETTE_COUNT)
+        return;
+
+    ws2812_palette_expand(palettes[palette].keys, palettes[palette].count,
+                          heat_palette);
 }
 
 
 
+// ws2812_i2s_update() copies pixels into its own DMA buffer, so one
+// frame buffer is enough
 ws2812_pixel_t pixels[NUM_LEDS];
-bool fireplace_on = false;
 
-void fireplace_update() {
-    // Update fire animation
-    static unsigned int stack[WIDTH][HEIGHT] = {};
+ws2812_color16_t colors[NUM_LEDS];
+led_matrix_t matrix;
+ws2812_dither_t dither;
+ws2812_output_t output;
+bool fireplace_on = false;
 
-    unsigned int hot = 256 * brightness.value.int_value / 100;
-    unsigned int maxhot = hot * HEIGHT;
+animation_t fire_animation;
+animation_t identify_animation;
 
-    // 1. Cool all the sparks
-    for(int i=0; i < WIDTH; i++) {
-        for (int j=0; j < HEIGHT; j++) {
-            unsigned int cooling = hwrand() % COOLING;
-            stack[i][j] = (stack[i][j] < cooling) ? 0 : stack[i][j] - cooling;
-        }
+// Identify owns the pixels while it runs, fire is started again
+// after it if the fireplace is on by then
+bool identify_running = false;
+int identify_step;
+int identify_column;
 
-        if (stack[i][0] < hot) {
-            stack[i][0] = hot + hwrand() % (maxhot - hot);
-        }
-    }
+// Split of fire frame time, pacing is tracked by the scheduler
+typedef struct {
+    uint32_t compute_us;
+    uint32_t compute_max_us;
+    uint32_t transmit_us;
+    uint32_t transmit_max_us;
+} fireplace_stats_t;
 
-    for( int i = 0; i < WIDTH; i++) {
-        for( int j = HEIGHT-1; j > 0; j--) {
-            unsigned long heat = stack[i][j] + stack[i][j-1];
-            if (i > 0)
-                heat += stack[i-1][j-1];
-            if (i < WIDTH-1)
-                heat += stack[i+1][j-1];
+fireplace_stats_t stats;
 
-            stack[i][j] = heat / 6;
-        }
-    }
+void fireplace_update() {
+    // Update fire animation
+    fire_update(256 * brightness.value.int_value / 100);
 
     for (int i = 0; i < WIDTH; i++) {
         for (int j = 0; j < HEIGHT; j++) {
-            uint8_t index = ((unsigned long)stack[i][j]) / HEIGHT * 2;
-            ws2812_pixel_t color = heat_color(index);
-
-            if (i % 2 == 0) {
-                pixels[(i*HEIGHT) + j] = color;
-            } else {
-                pixels[(i*HEIGHT) + HEIGHT - j - 1] = color;
-            }
+            ws2812_color16_t color = heat_palette[fire_palette_index(i, j)];
+
+            colors[led_matrix_index(&matrix, i, j)] = color;
         }
     }
 
-    ws2812_i2s_update(pixels, PIXEL_RGB);
+    ws2812_dither_frame(&dither, colors, pixels);
 }
 
 void fireplace_clear() {
     memset(pixels, 0, sizeof(pixels));
-    ws2812_i2s_update(pixels, PIXEL_RGB);
+    ws2812_output_update(&output, pixels);
 }
 
-void fireplace_task(void *_arg) {
-    while (fireplace_on) {
-        fireplace_update();
+bool fireplace_frame(void *_context) {
+    uint32_t start = sdk_system_get_time();
+    fireplace_update();
+    uint32_t computed = sdk_system_get_time();
+    ws2812_output_update(&output, pixels);
+    uint32_t submitted = sdk_system_get_time();
 
-        vTaskDelay(FPS_DELAY);
-    }
+    stats.compute_us = computed - start;
+    stats.transmit_us = submitted - computed;
+    stats.transmit_max_us = max(stats.transmit_max_us, stats.transmit_us);
+    stats.compute_max_us = max(stats.compute_max_us, stats.compute_us);
 
-    fireplace_clear();
-    vTaskDelete(NULL);
+    return true;
 }
 
-void fireplace_init() {
-    ws2812_i2s_init(NUM_LEDS, PIXEL_RGB);
-    memset(pixels, 0, sizeof(pixels));
+void fireplace_start() {
+    memset(&stats, 0, sizeof(stats));
+    animation_start(&fire_animation);
 }
 
-void fireplace_start() {
-    fireplace_on = true;
-    xTaskCreate(fireplace_task, "Fireplace", 256, NULL, 2, NULL);
+void fireplace_stop() {
+    animation_stop(&fire_animation);
+
+    fireplace_clear();
+    animation_print_stats(&fire_animation);
+    printf("Fireplace frames: %u sent, %u skipped (%u us each)\n",
+           output.frames_sent, output.frames_skipped, output.frame_us);
+    printf("Fireplace frame time: compute %u us (max %u), transmit %u us (max %u)\n",
+           stats.compute_us, stats.compute_max_us, stats.transmit_us, stats.transmit_max_us);
 }
 
 void _fill_column(int column, ws2812_pixel_t color) {
-    if (column % 2 == 0) {
-        for (int j = 0; j < HEIGHT; j++)
-            pixels[(column*HEIGHT) + j] = color;
-    } else {
-        for (int j = 0; j < HEIGHT; j++)
-            pixels[(column*HEIGHT) + HEIGHT - j - 1] = color;
-    }
+    for (int j = 0; j < HEIGHT; j++)
+        pixels[led_matrix_index(&matrix, column, j)] = color;
 }
 
-void fireplace_identify_task(void *_args) {
-    bool old_on = fireplace_on;
-    fireplace_on = false;
-    vTaskDelay(2*FPS_DELAY);
-
+bool fireplace_identify_frame(void *_context) {
+    // Blank frame, then a red column sweeping right and left twice
+    // (one sweep visits columns 0..WIDTH-1..1), then blank again
+    const int sweep = 2*WIDTH - 2;
     ws2812_pixel_t black = { .color=0x000000 };
     ws2812_pixel_t red = { .color=0x990000 };
 
-    memset(pixels, 0, sizeof(pixels));
-    ws2812_i2s_update(pixels, PIXEL_RGB);
-    vTaskDelay(100 / portTICK_PERIOD_MS);
+    int step = identify_step++;
+    if (step == 0) {
+        memset(pixels, 0, sizeof(pixels));
+        ws2812_output_update(&output, pixels);
+        return true;
+    }
 
-    for (int x = 0; x < 2; x++) {
-        for (int i = 0; i < WIDTH; i++) {
-            _fill_column(i, red);
-            ws2812_i2s_update(pixels, PIXEL_RGB);
+    if (identify_column >= 0)
+        _fill_column(identify_column, black);
 
-            vTaskDelay(100 / portTICK_PERIOD_MS);
-            _fill_column(i, black);
-        }
+    if (step > 2*sweep) {
+        ws2812_output_update(&output, pixels);
 
-        for (int i = WIDTH-2; i > 0; i--) {
-            _fill_column(i, red);
-            ws2812_i2s_update(pixels, PIXEL_RGB);
+        // Fire can't be switched while identify runs, this
+        // picks up whatever the last write of ON was
+        taskENTER_CRITICAL();
+        identify_running = false;
+        bool restore = fireplace_on;
+        taskEXIT_CRITICAL();
 
-            vTaskDelay(100 / portTICK_PERIOD_MS);
-            _fill_column(i, black);
-        }
+        if (restore)
+            fireplace_start();
+        return false;
     }
 
-    ws2812_i2s_update(pixels, PIXEL_RGB);
+    int k = (step - 1) % sweep;
+    identify_column = (k < WIDTH) ? k : sweep - k;
+    _fill_column(identify_column, red);
+    ws2812_output_update(&output, pixels);
 
-    if (old_on)
-        fireplace_start();
+    return true;
+}
 
-    vTaskDelete(NULL);
+int fireplace_init() {
+    ws2812_i2s_init(NUM_LEDS, PIXEL_RGB);
+    ws2812_output_init(&output, NUM_LEDS, PIXEL_RGB);
+    if (ws2812_dither_init(&dither, NUM_LEDS)) {
+        printf("Failed to initialize dithering\n");
+        return -1;
+    }
+    if (led_matrix_init(&matrix, &matrix_layout)) {
+        printf("Failed to initialize LED matrix\n");
+        ws2812_dither_done(&dither);
+        return -1;
+    }
+    fireplace_set_palette(PALETTE_FIRE);
+    memset(pixels, 0, sizeof(pixels));
+
+    animation_register(&fire_animation, "Fireplace", FPS, fireplace_frame, NULL);
+    animation_register(&identify_animation, "Fireplace identify", IDENTIFY_FPS,
+                       fireplace_identify_frame, NULL);
+    return 0;
 }
 
 void fireplace_identify(homekit_value_t _value) {
     printf("Fireplace identify\n");
-    xTaskCreate(fireplace_identify_task, "Fireplace identify", 256, NULL, 2, NULL);
+
+    // Once stopped, no identify frame can start the fire any more
+    animation_stop(&identify_animation);
+    taskENTER_CRITICAL();
+    identify_running = true;
+    taskEXIT_CRITICAL();
+    animation_stop(&fire_animation);
+
+    identify_step = 0;
+    identify_column = -1;
+    animation_start(&identify_animation);
 }
 
 homekit_value_t fireplace_on_get() {
@@ -249,10 +321,21 @@ void fireplace_on_set(homekit_value_t value) {
         return;
     }
 
-    if (value.bool_value && !fireplace_on) {
+    taskENTER_CRITICAL();
+    bool changed = value.bool_value != fireplace_on;
+    bool identifying = identify_running;
+    fireplace_on = value.bool_value;
+    taskEXIT_CRITICAL();
+
+    // Identify starts the fire itself when it's done
+    if (!changed || identifying)
+        return;
+
+    if (fireplace_on) {
         fireplace_start();
+    } else {
+        fireplace_stop();
     }
-    fireplace_on = value.bool_value;
 }
 
 
@@ -292,7 +375,11 @@ void user_init(void) {
     uart_set_baud(0, 115200);
 
     wifi_init();
-    fireplace_init();
+    if (fireplace_init()) {
+        printf("Failed to initialize fireplace\n");
+        return;
+    }
+    fireplace_on = true;
     fireplace_start();
     homekit_server_init(&config);
 }
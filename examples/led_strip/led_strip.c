@@ -18,17 +18,20 @@
 #include <esp8266.h>
 #include <FreeRTOS.h>
 #include <task.h>
-#include <math.h>
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <color.h>
 #include "wifi.h"
 #include "ws2812_i2s/ws2812_i2s.h"
+#include <ws2812_frame.h>
 
 #define LED_ON 0                // this is the value to write to GPIO for led on (0 = GPIO low)
 #define LED_INBUILT_GPIO 2      // this is the onboard LED used to show on/off only
 #define LED_COUNT 16            // this is the number of WS2812B leds on the strip
-#define LED_RGB_SCALE 255       // this is the scaling factor used for color conversion
+#define LED_RGB_SCALE 65535     // this is the scaling factor used for color conversion (dithered down to 8 bits)
+#define LED_DITHER_INTERVAL 10  // this is the refresh period in milliseconds while dithering
+#define LED_DITHER_FRAMES WS2812_DITHER_CYCLE  // this is how many frames a color is dithered before it settles
 
 // Global variables
 float led_hue = 0;              // hue is scaled 0 to 360
@@ -36,58 +39,102 @@ float led_saturation = 59;      // saturation is scaled 0 to 100
 float led_brightness = 100;     // brightness is scaled 0 to 100
 bool led_on = false;            // on is boolean on or off
 ws2812_pixel_t pixels[LED_COUNT];
+ws2812_color16_t led_color;     // current 16 bit color of the strip
+ws2812_dither_t dither;
+ws2812_output_t output;
+TaskHandle_t led_dither_task_handle = NULL;
+volatile bool led_identify_requested = false;
+
+static void hsi2rgb(float h, float s, float i, ws2812_color16_t* rgb) {
+    color_rgbw_t color;
+    color_hsi2rgb(color_hue(h), color_percent(s),
+                  color_intensity_perceptual(color_percent(i)), LED_RGB_SCALE, &color);
+
+    rgb->red = color.red;
+    rgb->green = color.green;
+    rgb->blue = color.blue;
+}
+
+void led_string_fill(ws2812_pixel_t rgb) {
 
-//http://blog.saikoled.com/post/44677718712/how-to-convert-from-hsi-to-rgb-white
-static void hsi2rgb(float h, float s, float i, ws2812_pixel_t* rgb) {
-    int r, g, b;
-
-    while (h < 0) { h += 360.0F; };     // cycle h around to 0-360 degrees
-    while (h >= 360) { h -= 360.0F; };
-    h = 3.14159F*h / 180.0F;            // convert to radians.
-    s /= 100.0F;                        // from percentage to ratio
-    i /= 100.0F;                        // from percentage to ratio
-    s = s > 0 ? (s < 1 ? s : 1) : 0;    // clamp s and i to interval [0,1]
-    i = i > 0 ? (i < 1 ? i : 1) : 0;    // clamp s and i to interval [0,1]
-    i = i * sqrt(i);                    // shape intensity to have finer granularity near 0
-
-    if (h < 2.09439) {
-        r = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        g = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        b = LED_RGB_SCALE * i / 3 * (1 - s);
+    // write out the new color to each pixel
+    for (int i = 0; i < LED_COUNT; i++) {
+        pixels[i] = rgb;
     }
-    else if (h < 4.188787) {
-        h = h - 2.09439;
-        g = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        b = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        r = LED_RGB_SCALE * i / 3 * (1 - s);
+    ws2812_output_update(&output, pixels);
+}
+
+// settle shows the nearest 8 bit color, which needs no more refreshing
+void led_string_show(bool settle) {
+    // led_color is written by the HomeKit task
+    taskENTER_CRITICAL();
+    ws2812_color16_t color = led_color;
+    taskEXIT_CRITICAL();
+
+    if (settle) {
+        color = ws2812_color16_round(color);
     }
-    else {
-        h = h - 4.188787;
-        b = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        r = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        g = LED_RGB_SCALE * i / 3 * (1 - s);
+
+    ws2812_dither_fill(&dither, color, pixels);
+    ws2812_output_update(&output, pixels);
+    //printf("dither: %d bytes, %d cycles\n", ws2812_dither_ram(&dither), dither.frame_cycles);
+    //printf("frames: %d sent, %d skipped\n", output.frames_sent, output.frames_skipped);
+}
+
+void led_identify_show(void) {
+    const ws2812_pixel_t COLOR_PINK = { { 255, 0, 127, 0 } };
+    const ws2812_pixel_t COLOR_BLACK = { { 0, 0, 0, 0 } };
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            gpio_write(LED_INBUILT_GPIO, LED_ON);
+            led_string_fill(COLOR_PINK);
+            vTaskDelay(100 / portTICK_PERIOD_MS);
+            gpio_write(LED_INBUILT_GPIO, 1 - LED_ON);
+            led_string_fill(COLOR_BLACK);
+            vTaskDelay(100 / portTICK_PERIOD_MS);
+        }
+        vTaskDelay(250 / portTICK_PERIOD_MS);
     }
 
-    rgb->red = (uint8_t) r;
-    rgb->green = (uint8_t) g;
-    rgb->blue = (uint8_t) b;
-    rgb->white = (uint8_t) 0;           // white channel is not used
+    gpio_write(LED_INBUILT_GPIO, led_on ? LED_ON : 1 - LED_ON);
 }
 
-void led_string_fill(ws2812_pixel_t rgb) {
+// The only task that writes to the strip, identify is one of the things it shows
+void led_dither_task(void *_args) {
+    const TickType_t xPeriod = pdMS_TO_TICKS(LED_DITHER_INTERVAL);
+    TickType_t xLastWakeTime = xTaskGetTickCount();
+    uint32_t frames = 0;
 
-    // write out the new color to each pixel
-    for (int i = 0; i < LED_COUNT; i++) {
-        pixels[i] = rgb;
+    for (;;) {
+        if (led_identify_requested) {
+            led_identify_requested = false;
+            led_identify_show();
+        }
+        // the pattern repeats after a full cycle, the strip then stays
+        // on the nearest 8 bit color instead of being resent forever
+        led_string_show(++frames >= LED_DITHER_FRAMES);
+
+        if (dither.pending) {
+            // color falls between 8 bit steps, keep refreshing,
+            // a new color starts a new cycle
+            vTaskDelayUntil(&xLastWakeTime, xPeriod);
+            if (ulTaskNotifyTake(pdTRUE, 0)) {
+                frames = 0;
+            }
+        } else {
+            // static frame, sleep until the color changes
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            xLastWakeTime = xTaskGetTickCount();
+            frames = 0;
+        }
     }
-    ws2812_i2s_update(pixels, PIXEL_RGB);
 }
 
 void led_string_set(void) {
-    ws2812_pixel_t rgb = { { 0, 0, 0, 0 } };
+    ws2812_color16_t rgb = { 0, 0, 0 };
 
     if (led_on) {
-        // convert HSI to RGBW
         hsi2rgb(led_hue, led_saturation, led_brightness, &rgb);
         //printf("h=%d,s=%d,b=%d => ", (int)led_hue, (int)led_saturation, (int)led_brightness);
         //printf("r=%d,g=%d,b=%d,w=%d\n", rgbw.red, rgbw.green, rgbw.blue, rgbw.white);
@@ -100,8 +147,11 @@ void led_string_set(void) {
         gpio_write(LED_INBUILT_GPIO, 1 - LED_ON);
     }
 
-    // write out the new color 
-    led_string_fill(rgb);
+    // hand the new color over to the dither task
+    taskENTER_CRITICAL();
+    led_color = rgb;
+    taskEXIT_CRITICAL();
+    xTaskNotifyGive(led_dither_task_handle);
 }
 
 static void wifi_init() {
@@ -121,34 +171,18 @@ void led_init() {
 
     // initialise the LED strip
     ws2812_i2s_init(LED_COUNT, PIXEL_RGB);
+    ws2812_output_init(&output, LED_COUNT, PIXEL_RGB);
+    ws2812_dither_init(&dither, LED_COUNT);
+    xTaskCreate(led_dither_task, "LED dither", 256, NULL, 2, &led_dither_task_handle);
 
     // set the initial state
     led_string_set();
 }
 
-void led_identify_task(void *_args) {
-    const ws2812_pixel_t COLOR_PINK = { { 255, 0, 127, 0 } };
-    const ws2812_pixel_t COLOR_BLACK = { { 0, 0, 0, 0 } };
-
-    for (int i = 0; i < 3; i++) {
-        for (int j = 0; j < 3; j++) {
-            gpio_write(LED_INBUILT_GPIO, LED_ON);
-            led_string_fill(COLOR_PINK);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
-            gpio_write(LED_INBUILT_GPIO, 1 - LED_ON);
-            led_string_fill(COLOR_BLACK);
-            vTaskDelay(100 / portTICK_PERIOD_MS);
-        }
-        vTaskDelay(250 / portTICK_PERIOD_MS);
-    }
-
-    led_string_set();
-    vTaskDelete(NULL);
-}
-
 void led_identify(homekit_value_t _value) {
     // printf("LED identify\n");
-    xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
+    led_identify_requested = true;
+    xTaskNotifyGive(led_dither_task_handle);
 }
 
 homekit_value_t led_on_get() {
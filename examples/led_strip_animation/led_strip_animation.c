@@ -19,10 +19,11 @@
 #include <esp8266.h>
 #include <FreeRTOS.h>
 #include <task.h>
-#include <math.h>
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
+#include <color.h>
+#include <write_batch.h>
 #include "wifi.h"
 
 #include "WS2812FX/WS2812FX.h"
@@ -43,41 +44,19 @@ float fx_saturation = 50;      // saturation is scaled 0 to 100
 float fx_brightness = 50;     // brightness is scaled 0 to 100
 bool fx_on = true;
 
-//http://blog.saikoled.com/post/44677718712/how-to-convert-from-hsi-to-rgb-white
-static void hsi2rgb(float h, float s, float i, ws2812_pixel_t* rgb) {
-    int r, g, b;
-
-    while (h < 0) { h += 360.0F; };     // cycle h around to 0-360 degrees
-    while (h >= 360) { h -= 360.0F; };
-    h = 3.14159F*h / 180.0F;            // convert to radians.
-    s /= 100.0F;                        // from percentage to ratio
-    i /= 100.0F;                        // from percentage to ratio
-    s = s > 0 ? (s < 1 ? s : 1) : 0;    // clamp s and i to interval [0,1]
-    i = i > 0 ? (i < 1 ? i : 1) : 0;    // clamp s and i to interval [0,1]
-    i = i * sqrt(i);                    // shape intensity to have finer granularity near 0
-
-    if (h < 2.09439) {
-        r = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        g = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        b = LED_RGB_SCALE * i / 3 * (1 - s);
-    }
-    else if (h < 4.188787) {
-        h = h - 2.09439;
-        g = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        b = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        r = LED_RGB_SCALE * i / 3 * (1 - s);
-    }
-    else {
-        h = h - 4.188787;
-        b = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        r = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        g = LED_RGB_SCALE * i / 3 * (1 - s);
-    }
+// Setters only store values, one controller write updates the strip once
+write_batch_t led_batch;
+write_batch_t fx_batch;
 
-    rgb->red = (uint8_t) r;
-    rgb->green = (uint8_t) g;
-    rgb->blue = (uint8_t) b;
-    rgb->white = (uint8_t) 0;           // white channel is not used
+static void hsi2rgb(float h, float s, float i, ws2812_pixel_t* rgb) {
+    color_rgbw_t color;
+    color_hsi2rgb(color_hue(h), color_percent(s),
+                  color_intensity_perceptual(color_percent(i)), LED_RGB_SCALE, &color);
+
+    rgb->red = color.red;
+    rgb->green = color.green;
+    rgb->blue = color.blue;
+    rgb->white = 0;                     // white channel is not used
 }
 
 static void wifi_init() {
@@ -116,6 +95,27 @@ void led_identify(homekit_value_t _value) {
     xTaskCreate(led_identify_task, "LED identify", 128, NULL, 2, NULL);
 }
 
+void led_apply(void *_context) {
+    ws2812_pixel_t rgb = { { 0, 0, 0, 0 } };
+    hsi2rgb(led_hue, led_saturation, 100, &rgb);
+    
+    WS2812FX_setColor(rgb.red, rgb.green, rgb.blue);
+
+    if (led_on) {
+        WS2812FX_setBrightness(color_gamma8(color_level(color_percent(led_brightness))));
+    } else {
+        WS2812FX_setBrightness(0);
+    }
+}
+
+void fx_apply(void *_context) {
+    if (fx_on) {
+        WS2812FX_setMode360(fx_hue);
+    } else {
+        WS2812FX_setMode360(0);
+    }
+}
+
 homekit_value_t led_on_get() {
     return HOMEKIT_BOOL(led_on);
 }
@@ -127,13 +127,7 @@ void led_on_set(homekit_value_t value) {
     }
 
     led_on = value.bool_value;
-    
-    if (led_on) {
-        WS2812FX_setBrightness((uint8_t)floor(led_brightness*2.55));
-        
-    } else {
-        WS2812FX_setBrightness(0);
-    }
+    write_batch_touch(&led_batch);
 }
 
 homekit_value_t led_brightness_get() {
@@ -146,8 +140,7 @@ void led_brightness_set(homekit_value_t value) {
         return;
     }
     led_brightness = value.int_value;
-    
-    WS2812FX_setBrightness((uint8_t)floor(led_brightness*2.55));
+    write_batch_touch(&led_batch);
 }
 
 homekit_value_t led_hue_get() {
@@ -160,11 +153,7 @@ void led_hue_set(homekit_value_t value) {
         return;
     }
     led_hue = value.float_value;
-    
-    ws2812_pixel_t rgb = { { 0, 0, 0, 0 } };
-    hsi2rgb(led_hue, led_saturation, 100, &rgb);
-    
-    WS2812FX_setColor(rgb.red, rgb.green, rgb.blue);
+    write_batch_touch(&led_batch);
 }
 
 homekit_value_t led_saturation_get() {
@@ -177,11 +166,7 @@ void led_saturation_set(homekit_value_t value) {
         return;
     }
     led_saturation = value.float_value;
-    
-    ws2812_pixel_t rgb = { { 0, 0, 0, 0 } };
-    hsi2rgb(led_hue, led_saturation, 100, &rgb);
-    
-    WS2812FX_setColor(rgb.red, rgb.green, rgb.blue);
+    write_batch_touch(&led_batch);
 }
 
 homekit_value_t fx_on_get() {
@@ -194,12 +179,7 @@ void fx_on_set(homekit_value_t value) {
         return;
     }
     fx_on = value.bool_value;
-    
-    if (fx_on) {
-        WS2812FX_setMode360(fx_hue);
-    } else {
-        WS2812FX_setMode360(0);
-    }
+    write_batch_touch(&fx_batch);
 }
 
 homekit_value_t fx_brightness_get() {
@@ -234,8 +214,7 @@ void fx_hue_set(homekit_value_t value) {
         return;
     }
     fx_hue = value.float_value;
-    
-    WS2812FX_setMode360(fx_hue);
+    write_batch_touch(&fx_batch);
 }
 
 homekit_value_t fx_saturation_get() {
@@ -336,6 +315,8 @@ void user_init(void) {
 
     wifi_init();
     WS2812FX_init(LED_COUNT);
+    write_batch_init(&led_batch, "LED", 256, led_apply, NULL);
+    write_batch_init(&fx_batch, "FX", 256, fx_apply, NULL);
     homekit_server_init(&config);
     
     led_identify(HOMEKIT_INT(led_brightness));
@@ -11,27 +11,29 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <espressif/esp_wifi.h>
 #include <espressif/esp_sta.h>
 #include <esp/uart.h>
 #include <esp8266.h>
 #include <FreeRTOS.h>
 #include <task.h>
-#include <math.h> 
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
 #include <wifi_config.h>
+#include <color.h>
+#include <transition.h>
 
 #include "multipwm.h"
 
-#define LPF_SHIFT 4  // divide by 16
-#define LPF_INTERVAL 10  // in milliseconds
+#define FADE_DURATION 500   // in milliseconds
+#define FADE_INTERVAL 10    // in milliseconds
 
 #define RED_PWM_PIN 5
 #define GREEN_PWM_PIN 12
 #define BLUE_PWM_PIN 13
-#define LED_RGB_SCALE 255       // this is the scaling factor used for color conversion
+#define LED_RGB_SCALE 0xffff    // this is the scaling factor used for color conversion, full PWM duty
 
 typedef union {
     struct {
@@ -43,72 +45,90 @@ typedef union {
     uint64_t color;
 } rgb_color_t;
 
-// Color smoothing variables
-rgb_color_t current_color = { { 0, 0, 0, 0 } };
+// Target is computed once per write, the PWM task fades towards it
 rgb_color_t target_color = { { 0, 0, 0, 0 } };
+uint32_t fade_duration = FADE_DURATION;
+
+// PWM task sleeps once the fade is done, a new target wakes it up
+TaskHandle_t multipwm_task_handle = NULL;
+uint32_t multipwm_wakeups = 0;  // loop iterations, including fade steps
+uint32_t multipwm_updates = 0;  // PWM restarts with new duties
 
 // Global variables
 float led_hue = 0;              // hue is scaled 0 to 360
 float led_saturation = 59;      // saturation is scaled 0 to 100
 float led_brightness = 100;     // brightness is scaled 0 to 100
 bool led_on = false;            // on is boolean on or off
+uint16_t led_ct = 250;          // color temperature in mired
+bool led_ct_mode = false;       // last color came as color temperature, not hue/saturation
 
-//http://blog.saikoled.com/post/44677718712/how-to-convert-from-hsi-to-rgb-white
 static void hsi2rgb(float h, float s, float i, rgb_color_t* rgb) {
-    int r, g, b;
-
-    while (h < 0) { h += 360.0F; };     // cycle h around to 0-360 degrees
-    while (h >= 360) { h -= 360.0F; };
-    h = 3.14159F*h / 180.0F;            // convert to radians.
-    s /= 100.0F;                        // from percentage to ratio
-    i /= 100.0F;                        // from percentage to ratio
-    s = s > 0 ? (s < 1 ? s : 1) : 0;    // clamp s and i to interval [0,1]
-    i = i > 0 ? (i < 1 ? i : 1) : 0;    // clamp s and i to interval [0,1]
-    //i = i * sqrt(i);                    // shape intensity to have finer granularity near 0
-
-    if (h < 2.09439) {
-        r = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        g = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        b = LED_RGB_SCALE * i / 3 * (1 - s);
-    }
-    else if (h < 4.188787) {
-        h = h - 2.09439;
-        g = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        b = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        r = LED_RGB_SCALE * i / 3 * (1 - s);
-    }
-    else {
-        h = h - 4.188787;
-        b = LED_RGB_SCALE * i / 3 * (1 + s * cos(h) / cos(1.047196667 - h));
-        r = LED_RGB_SCALE * i / 3 * (1 + s * (1 - cos(h) / cos(1.047196667 - h)));
-        g = LED_RGB_SCALE * i / 3 * (1 - s);
+    color_rgbw_t color;
+    color_hsi2rgb(color_hue(h), color_percent(s),
+                  color_intensity_perceptual(color_percent(i)), LED_RGB_SCALE, &color);
+
+    rgb->red = color.red;
+    rgb->green = color.green;
+    rgb->blue = color.blue;
+}
+
+// target_color is 64 bit, the ESP8266 writes it in two halves, so it is
+// only accessed in a critical section to keep the PWM task from seeing
+// half of a new color
+static rgb_color_t led_get_target() {
+    taskENTER_CRITICAL();
+    rgb_color_t color = target_color;
+    taskEXIT_CRITICAL();
+    return color;
+}
+
+static void led_set_target(rgb_color_t color) {
+    taskENTER_CRITICAL();
+    target_color = color;
+    taskEXIT_CRITICAL();
+    if (multipwm_task_handle) {
+        xTaskNotifyGive(multipwm_task_handle);
     }
+}
 
-    rgb->red = (uint8_t) r;
-    rgb->green = (uint8_t) g;
-    rgb->blue = (uint8_t) b;
+static void led_update() {
+    rgb_color_t color = { { 0, 0, 0, 0 } };
+    if (led_on && led_ct_mode) {
+        color_rgbw_t rgb;
+        color_mired2rgb(led_ct, color_intensity_perceptual(color_percent(led_brightness)), LED_RGB_SCALE, &rgb);
+        color.red = rgb.red;
+        color.green = rgb.green;
+        color.blue = rgb.blue;
+    } else if (led_on) {
+        // convert HSI to RGBW
+        hsi2rgb(led_hue, led_saturation, led_brightness, &color);
+    }
+    led_set_target(color);
 }
 
 void led_identify_task(void *_args) {
     printf("LED identify\n");
     
-    rgb_color_t color = target_color;
+    rgb_color_t color = led_get_target();
     rgb_color_t black_color = { { 0, 0, 0, 0 } };
-    rgb_color_t white_color = { { 128, 128, 128, 128 } };
+    rgb_color_t white_color = { { 0x8000, 0x8000, 0x8000, 0x8000 } };
     
+    // Blink sharply, then fade back to the color
+    fade_duration = 0;
     for (int i=0; i<3; i++) {
         for (int j=0; j<2; j++) {
-            target_color = white_color;
+            led_set_target(white_color);
             vTaskDelay(100 / portTICK_PERIOD_MS);
             
-            target_color = black_color;
+            led_set_target(black_color);
             vTaskDelay(100 / portTICK_PERIOD_MS);
         }
 
         vTaskDelay(250 / portTICK_PERIOD_MS);
     }
 
-    target_color = color;
+    fade_duration = FADE_DURATION;
+    led_set_target(color);
 
     vTaskDelete(NULL);
 }
@@ -128,6 +148,7 @@ void led_on_set(homekit_value_t value) {
     }
 
     led_on = value.bool_value;
+    led_update();
 }
 
 homekit_value_t led_brightness_get() {
@@ -140,6 +161,7 @@ void led_brightness_set(homekit_value_t value) {
         return;
     }
     led_brightness = value.int_value;
+    led_update();
 }
 
 homekit_value_t led_hue_get() {
@@ -152,6 +174,8 @@ void led_hue_set(homekit_value_t value) {
         return;
     }
     led_hue = value.float_value;
+    led_ct_mode = false;
+    led_update();
 }
 
 homekit_value_t led_saturation_get() {
@@ -164,6 +188,22 @@ void led_saturation_set(homekit_value_t value) {
         return;
     }
     led_saturation = value.float_value;
+    led_ct_mode = false;
+    led_update();
+}
+
+homekit_value_t led_ct_get() {
+    return HOMEKIT_UINT32(led_ct);
+}
+
+void led_ct_set(homekit_value_t value) {
+    if (value.format != homekit_format_uint32) {
+        // printf("Invalid ct-value format: %d\n", value.format);
+        return;
+    }
+    led_ct = value.uint32_value;
+    led_ct_mode = true;
+    led_update();
 }
 
 homekit_characteristic_t name = HOMEKIT_CHARACTERISTIC_(NAME, "LED Strip");
@@ -201,6 +241,13 @@ homekit_accessory_t *accessories[] = {
                 .getter = led_saturation_get,
                 .setter = led_saturation_set
             ),
+            HOMEKIT_CHARACTERISTIC(
+                COLOR_TEMPERATURE, 250,
+                .getter = led_ct_get,
+                .setter = led_ct_set,
+                .min_value = (float[]) {COLOR_MIRED_MIN},
+                .max_value = (float[]) {COLOR_MIRED_MAX}
+            ),
             NULL
         }),
         NULL
@@ -214,7 +261,7 @@ homekit_server_config_t config = {
 };
 
 IRAM void multipwm_task(void *pvParameters) {
-    const TickType_t xPeriod = pdMS_TO_TICKS(LPF_INTERVAL);
+    const TickType_t xPeriod = pdMS_TO_TICKS(FADE_INTERVAL);
     TickType_t xLastWakeTime = xTaskGetTickCount();
     
     uint8_t pins[] = {RED_PWM_PIN, GREEN_PWM_PIN, BLUE_PWM_PIN};
@@ -228,27 +275,46 @@ IRAM void multipwm_task(void *pvParameters) {
         multipwm_set_pin(&pwm_info, i, pins[i]);
     }
 
+    transition_t fade;
+    transition_init(&fade, 3, FADE_DURATION, TRANSITION_EASE_IN_OUT);
+    rgb_color_t fade_target = { { 0, 0, 0, 0 } };
+
+    uint16_t duty[3];
+    bool duty_valid = false;
+
     while(1) {
-        if (led_on) {
-            // convert HSI to RGBW
-            hsi2rgb(led_hue, led_saturation, led_brightness, &target_color);
+        multipwm_wakeups++;
+        uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+        rgb_color_t color = led_get_target();
+        if (color.color != fade_target.color) {
+            uint16_t target[] = {color.red, color.green, color.blue};
+            transition_configure(&fade, fade_duration, TRANSITION_EASE_IN_OUT);
+            transition_set_target(&fade, target, now);
+            fade_target = color;
+        }
+        transition_step(&fade, now);
+
+        // Restarting PWM glitches the outputs, only do it for new duties
+        if (!duty_valid || memcmp(duty, fade.value, sizeof(duty))) {
+            memcpy(duty, fade.value, sizeof(duty));
+            duty_valid = true;
+            multipwm_updates++;
+
+            multipwm_stop(&pwm_info);
+            for (uint8_t i=0; i<pwm_info.channels; i++) {
+                multipwm_set_duty(&pwm_info, i, duty[i]);
+            }
+            multipwm_start(&pwm_info);
+        }
+
+        if (transition_active(&fade)) {
+            vTaskDelayUntil(&xLastWakeTime, xPeriod);
         } else {
-            target_color.red = 0;
-            target_color.green = 0;
-            target_color.blue = 0;
+            // printf("multipwm idle: %u wakeups, %u updates\n", multipwm_wakeups, multipwm_updates);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            xLastWakeTime = xTaskGetTickCount();
         }
-        
-        current_color.red += ((target_color.red * 256) - current_color.red) >> LPF_SHIFT ;
-        current_color.green += ((target_color.green * 256) - current_color.green) >> LPF_SHIFT ;
-        current_color.blue += ((target_color.blue * 256) - current_color.blue) >> LPF_SHIFT ;
-        
-        multipwm_stop(&pwm_info);
-        multipwm_set_duty(&pwm_info, 0, current_color.red);
-        multipwm_set_duty(&pwm_info, 1, current_color.green);
-        multipwm_set_duty(&pwm_info, 2, current_color.blue);
-        multipwm_start(&pwm_info);
-                
-        vTaskDelayUntil(&xLastWakeTime, xPeriod);
     }
 }
 
@@ -271,5 +337,5 @@ void user_init(void) {
 
     wifi_config_init("MagicHome Led Strip", NULL, on_wifi_ready);
     
-    xTaskCreate(multipwm_task, "multipwm", 256, NULL, 2, NULL);
+    xTaskCreate(multipwm_task, "multipwm", 256, NULL, 2, &multipwm_task_handle);
 }
@@ -30,10 +30,13 @@ modified to do pulse-width-modulation (PWM) of LED
 #include <esp8266.h>
 #include <FreeRTOS.h>
 #include <task.h>
+#include <queue.h>
 
 #include <homekit/homekit.h>
 #include <homekit/characteristics.h>
 #include <wifi_config.h>
+#include <color.h>
+#include <transition.h>
 #include "wifi.h"
 
 #include "button.h"
@@ -105,31 +108,107 @@ void gpio_init() {
 //    gpio_enable(relay_gpio, GPIO_OUTPUT);
     gpio_enable(toggle_gpio, GPIO_INPUT);
     pins[0] = led_gpio;
-    pwm_init(1, pins, false);
+    if (pwm_init(1, pins, false)) {
+        printf("Failed to initialize PWM\n");
+    }
+    // 1% is a few timer ticks at 1 kHz, too short for a pulse every period
+    if (pwm_set_dither(true)) {
+        printf("Failed to enable PWM dither\n");
+    }
 }
 
 
-void lightSET_task(void *pvParameters) {
-    int w;
-    if (on) {
-        w = (UINT16_MAX - UINT16_MAX*bri/100);
-        pwm_set_duty(w);
-        printf("ON  %3d [%5d]\n", (int)bri , w);
-    } else {
-        printf("OFF\n");
-        pwm_set_duty(UINT16_MAX);
+typedef struct {
+    bool on;
+    float bri;
+} light_state_t;
+
+#define LIGHT_FADE_DURATION 400  // in milliseconds
+#define LIGHT_FADE_INTERVAL 10   // in milliseconds
+
+// Holds only the latest state, so a burst of writes is applied once
+QueueHandle_t light_mailbox;
+uint32_t light_writes_received = 0;
+uint32_t light_writes_applied = 0;
+volatile bool light_identify_requested = false;
+
+void light_identify_show() {
+    //Identify Sonoff by Pulsing LED.
+    for (int j=0; j<3; j++) {
+        for (int j=0; j<2; j++) {
+            for (int i=0; i<=40; i++) {
+                int w;
+                float b;
+                w = (UINT16_MAX - UINT16_MAX*i/20);
+                if(i>20) {
+                    w = (UINT16_MAX - UINT16_MAX*abs(i-40)/20);
+                }
+                b = 100.0*(UINT16_MAX-w)/UINT16_MAX;
+                pwm_set_duty(w);
+                printf("Light_Identify: i = %2d b = %3.0f w = %5d\n",i, b, UINT16_MAX);
+                vTaskDelay(20 / portTICK_PERIOD_MS);
+            }
+        }
+    vTaskDelay(500 / portTICK_PERIOD_MS);
+    }
+}
+
+// The only task that sets PWM duty, identify is one of the things it shows
+void light_task(void *pvParameters) {
+    transition_t fade;
+    transition_init(&fade, 1, LIGHT_FADE_DURATION, TRANSITION_EASE_IN_OUT);
+
+    light_state_t state;
+    while (true) {
+        // Sleeps until the next write once the fade is done
+        TickType_t wait = transition_active(&fade) ?
+            pdMS_TO_TICKS(LIGHT_FADE_INTERVAL) : portMAX_DELAY;
+        BaseType_t received = xQueueReceive(light_mailbox, &state, wait);
+
+        // Writes coming in meanwhile wait in the mailbox, the fade
+        // then picks up from where it was
+        if (light_identify_requested) {
+            light_identify_requested = false;
+            light_identify_show();
+        }
+        uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+        if (received == pdTRUE) {
+            light_writes_applied++;
+
+            uint16_t level = state.on ? color_gamma16(color_level(color_percent(state.bri))) : 0;
+            // The lowest levels are shorter than a timer pulse and would
+            // turn the dimmer off, they get the dimmest pulse instead
+            uint16_t min_level = pwm_get_min_duty();
+            if (level && level < min_level)
+                level = min_level;
+            transition_set_target(&fade, &level, now);
+            if (state.on) {
+                printf("ON  %3d [%5d]", (int)state.bri , UINT16_MAX - level);
+            } else {
+                printf("OFF");
+            }
+            printf(" (writes %u received, %u applied)\n",
+                   light_writes_received, light_writes_applied);
+        }
+
+        transition_step(&fade, now);
+        pwm_set_duty(UINT16_MAX - fade.value[0]);
     }
-    vTaskDelete(NULL);
 }
 
 
 void lightSET() {
-    xTaskCreate(lightSET_task, "Light Set", 256, NULL, 2, NULL);
+    light_state_t state = { .on = on, .bri = bri };
+    light_writes_received++;
+    xQueueOverwrite(light_mailbox, &state);
 }
 
 
 void light_init() {
     printf("light_init:\n");
+    light_mailbox = xQueueCreate(1, sizeof(light_state_t));
+    xTaskCreate(light_task, "Light", 256, NULL, 2, NULL);
     on=false;
     bri=100;
     printf("on = false  bri = 100 %%\n");
@@ -164,34 +243,11 @@ void light_bri_set(homekit_value_t value) {
 }
 
 
-void light_identify_task(void *_args) {
-    //Identify Sonoff by Pulsing LED.
-    for (int j=0; j<3; j++) {
-        for (int j=0; j<2; j++) {
-            for (int i=0; i<=40; i++) {
-                int w;
-                float b;
-                w = (UINT16_MAX - UINT16_MAX*i/20);
-                if(i>20) {
-                    w = (UINT16_MAX - UINT16_MAX*abs(i-40)/20);
-                }
-                b = 100.0*(UINT16_MAX-w)/UINT16_MAX;
-                pwm_set_duty(w);
-                printf("Light_Identify: i = %2d b = %3.0f w = %5d\n",i, b, UINT16_MAX);
-                vTaskDelay(20 / portTICK_PERIOD_MS);
-            }
-        }
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-    }
-    pwm_set_duty(0);
-    lightSET();
-    vTaskDelete(NULL);
-}
-
-
 void light_identify(homekit_value_t _value) {
     printf("Light Identify\n");
-    xTaskCreate(light_identify_task, "Light identify", 256, NULL, 2, NULL);
+    light_identify_requested = true;
+    // Wakes the light task, which runs identify before the state
+    lightSET();
 }
 
 
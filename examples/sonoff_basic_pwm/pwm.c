@@ -7,6 +7,7 @@
  */
 #include "pwm.h"
 
+#include <stdio.h>
 #include <espressif/esp_common.h>
 #include <espressif/sdk_private.h>
 #include <FreeRTOS.h>
@@ -18,77 +19,345 @@
 #define debug(fmt, ...)
 #endif
 
+/* Timer runs at 80MHz / 16 whatever the frequency, so a frequency
+ * change is only a change of loads and can be latched like a duty */
+#define PWM_TIMER_DIVIDER   TIMER_CLKDIV_16
+#define PWM_TIMER_FREQ      (80000000 / 16)
+
+/* Timer ticks between two edges for the interrupt to keep up,
+ * edges closer than that are merged */
+#define PWM_MIN_LOAD    16
+
+/* Periods of a dither pattern. Each period on-time is a whole number
+ * of timer ticks, the pattern averages to 1/PWM_DITHER_PERIODS tick.
+ * Both schedules hold this many periods, about 224 bytes of RAM each,
+ * so it is 1 (no dithering) unless set at build time, e.g. 16 with
+ * EXTRA_CFLAGS += -DPWM_DITHER_PERIODS=16 */
+#ifndef PWM_DITHER_PERIODS
+#define PWM_DITHER_PERIODS  1
+#endif
+
+#if PWM_DITHER_PERIODS < 1 || PWM_DITHER_PERIODS > 255
+#error "PWM_DITHER_PERIODS must be between 1 and 255"
+#endif
+
 typedef struct PWMPinDefinition
 {
     uint8_t pin;
-    uint8_t divider;
+    uint16_t dutyCycle;
 } PWMPin;
 
-typedef enum {
-    PERIOD_ON   = 0,
-    PERIOD_OFF  = 1
-} pwm_step_t;
+/* One step of the period: pins to set and clear at its start,
+ * and timer load until the next step */
+typedef struct PWMEdgeDefinition
+{
+    uint32_t set;
+    uint32_t clear;
+    uint32_t load;
+} PWMEdge;
+
+
+typedef struct PWMPeriodDefinition
+{
+    uint8_t edgeCount;
+    PWMEdge edges[MAX_PWM_PINS + 1];
+} PWMPeriod;
+
+
+/* Periods run one after another, more than one in dither mode */
+typedef struct PWMScheduleDefinition
+{
+    uint8_t periodCount;
+    PWMPeriod periods[PWM_DITHER_PERIODS];
+} PWMSchedule;
 
 
 typedef struct pwmInfoDefinition
 {
     uint8_t running;
-    bool output;
     bool reverse;
+    bool dither;
 
     uint16_t freq;
-    uint16_t dutyCycle;
 
     /* private */
     uint32_t _maxLoad;
-    uint32_t _onLoad;
-    uint32_t _offLoad;
-    pwm_step_t _step;
+    uint32_t _allMask;
+
+    /* Interrupt runs the active schedule, updates are built into the
+     * other one and latched by the interrupt at the period boundary */
+    PWMSchedule _schedules[2];
+    volatile uint8_t _active;
+    volatile bool _pending;
+    volatile bool _timerRunning;
+    volatile uint8_t _period;
+    volatile uint8_t _step;
 
     uint16_t usedPins;
-    PWMPin pins[8];
+    PWMPin pins[MAX_PWM_PINS];
 } PWMInfo;
 
 static PWMInfo pwmInfo;
 
+static inline bool pwm_is_constant(const PWMSchedule *schedule)
+{
+    return schedule->periodCount == 1 && schedule->periods[0].edgeCount == 1;
+}
+
+static inline void pwm_next_step(const PWMSchedule *schedule)
+{
+    if (++pwmInfo._step == schedule->periods[pwmInfo._period].edgeCount)
+    {
+        pwmInfo._step = 0;
+        if (++pwmInfo._period == schedule->periodCount)
+        {
+            pwmInfo._period = 0;
+        }
+    }
+}
+
 static void IRAM frc1_interrupt_handler(void *arg)
 {
-    uint8_t i = 0;
-    bool out = true;
-    uint32_t load = pwmInfo._onLoad;
-    pwm_step_t step = PERIOD_ON;
+    if (pwmInfo._step == 0 && pwmInfo._pending)
+    {
+        pwmInfo._active ^= 1;
+        pwmInfo._pending = false;
+        pwmInfo._period = 0;
+    }
+
+    const PWMSchedule *schedule = &pwmInfo._schedules[pwmInfo._active];
+    const PWMEdge *edge = &schedule->periods[pwmInfo._period].edges[pwmInfo._step];
 
-    if (pwmInfo._step == PERIOD_ON)
+    GPIO.OUT_SET = edge->set;
+    GPIO.OUT_CLEAR = edge->clear;
+
+    if (pwm_is_constant(schedule))
     {
-        out = false;
-        load = pwmInfo._offLoad;
-        step = PERIOD_OFF;
+        // Constant output, timer is started again by next update
+        timer_set_run(FRC1, false);
+        pwmInfo._timerRunning = false;
+        return;
     }
 
-    for (; i < pwmInfo.usedPins; ++i)
+    timer_set_load(FRC1, edge->load);
+    pwm_next_step(schedule);
+}
+
+/* Builds edges of one period from pin on-times: all pins with
+ * some on-time go on at the start, then each distinct on-time clears
+ * the pins ending there. Returns number of edges, 1 if all pins
+ * are constant. */
+static uint8_t pwm_build_edges(PWMEdge *edges, const PWMPin *pins, const uint32_t *loads,
+                               uint8_t npins, uint32_t maxLoad, bool reverse)
+{
+    uint32_t onLoad[MAX_PWM_PINS];
+    uint32_t onMask = 0;
+    uint32_t offMask = 0;
+    uint8_t count = 1;
+
+    for (uint8_t i = 0; i < npins; ++i)
     {
-         gpio_write(pwmInfo.pins[i].pin, pwmInfo.reverse ? !out : out);
+        uint32_t mask = BIT(pins[i].pin);
+        uint32_t load = loads[i];
+
+        // Pulses too short for the timer become constant output
+        if (load < PWM_MIN_LOAD)
+        {
+            offMask |= mask;
+            continue;
+        }
+
+        onMask |= mask;
+        if (load > maxLoad - PWM_MIN_LOAD)
+        {
+            continue;
+        }
+
+        // Insertion sort into edges by on-time
+        uint8_t j = count;
+        while (j > 1 && onLoad[j - 2] > load)
+        {
+            onLoad[j - 1] = onLoad[j - 2];
+            edges[j] = edges[j - 1];
+            --j;
+        }
+        onLoad[j - 1] = load;
+        edges[j].set = 0;
+        edges[j].clear = mask;
+        ++count;
+    }
+
+    edges[0].set = onMask;
+    edges[0].clear = offMask;
+
+    // Merge edges that are too close to each other
+    uint8_t merged = 1;
+    uint32_t last = 0;
+    for (uint8_t i = 1; i < count; ++i)
+    {
+        if (merged > 1 && onLoad[i - 1] - last < PWM_MIN_LOAD)
+        {
+            edges[merged - 1].clear |= edges[i].clear;
+            continue;
+        }
+
+        last = onLoad[i - 1];
+        onLoad[merged - 1] = last;
+        edges[merged++] = edges[i];
+    }
+    count = merged;
+
+    // Timer load of each edge is the time until the next one
+    uint32_t start = 0;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        uint32_t end = (i + 1 < count) ? onLoad[i] : maxLoad;
+        edges[i].load = end - start;
+        start = end;
+
+        if (reverse)
+        {
+            uint32_t set = edges[i].set;
+            edges[i].set = edges[i].clear;
+            edges[i].clear = set;
+        }
     }
 
-    timer_set_load(FRC1, load);
-    pwmInfo._step = step;
+    return count;
 }
 
-void pwm_init(uint8_t npins, const uint8_t* pins, uint8_t reverse)
+/* First order delta-sigma over the pattern: each period takes the
+ * whole ticks of the target plus error carried from the previous one.
+ * Below PWM_MIN_LOAD pulses are skipped instead of shortened. */
+static uint32_t pwm_dither_load(int32_t *error, int32_t target, uint32_t maxLoad)
+{
+    int32_t want = target + *error;
+    uint32_t load = (want > 0) ? want / PWM_DITHER_PERIODS : 0;
+
+    if (load < PWM_MIN_LOAD)
+    {
+        load = (load >= PWM_MIN_LOAD / 2) ? PWM_MIN_LOAD : 0;
+    }
+    else if (load > maxLoad - PWM_MIN_LOAD)
+    {
+        load = (load >= maxLoad - PWM_MIN_LOAD / 2) ? maxLoad : maxLoad - PWM_MIN_LOAD;
+    }
+
+    *error = want - (int32_t)load * PWM_DITHER_PERIODS;
+    return load;
+}
+
+static void pwm_build(PWMSchedule *schedule)
+{
+    uint32_t loads[MAX_PWM_PINS];
+    int32_t targets[MAX_PWM_PINS];
+    int32_t errors[MAX_PWM_PINS];
+    uint8_t periods = pwmInfo.dither ? PWM_DITHER_PERIODS : 1;
+
+    for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
+    {
+        // Targets are in 1/PWM_DITHER_PERIODS of a tick
+        targets[i] = (uint64_t)pwmInfo.pins[i].dutyCycle * pwmInfo._maxLoad * PWM_DITHER_PERIODS / UINT16_MAX;
+        errors[i] = PWM_DITHER_PERIODS / 2;
+    }
+
+    bool constant = true;
+    for (uint8_t k = 0; k < periods; ++k)
+    {
+        for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
+        {
+            loads[i] = pwmInfo.dither
+                ? pwm_dither_load(&errors[i], targets[i], pwmInfo._maxLoad)
+                : (uint64_t)pwmInfo.pins[i].dutyCycle * pwmInfo._maxLoad / UINT16_MAX;
+        }
+
+        PWMPeriod *period = &schedule->periods[k];
+        period->edgeCount = pwm_build_edges(period->edges, pwmInfo.pins, loads, pwmInfo.usedPins,
+                                            pwmInfo._maxLoad, pwmInfo.reverse);
+        constant = constant && period->edgeCount == 1 &&
+                   period->edges[0].set == schedule->periods[0].edges[0].set;
+    }
+
+    // Same constant levels in every period need just one
+    schedule->periodCount = constant ? 1 : periods;
+}
+
+/* Starts a schedule from its first edge, timer must not be running */
+static void pwm_apply(const PWMSchedule *schedule)
+{
+    const PWMEdge *edge = &schedule->periods[0].edges[0];
+
+    GPIO.OUT_SET = edge->set;
+    GPIO.OUT_CLEAR = edge->clear;
+
+    // Only 0% and 100% duty cycles: constant output, no timer needed
+    if (!pwm_is_constant(schedule))
+    {
+        pwmInfo._period = 0;
+        pwmInfo._step = 0;
+        pwm_next_step(schedule);
+
+        pwmInfo._timerRunning = true;
+        timer_set_load(FRC1, edge->load);
+        timer_set_run(FRC1, true);
+    }
+}
+
+/* Hands new duties or frequency over to a running PWM without
+ * stopping it, so the current period always completes */
+static void pwm_update()
+{
+    if (!pwmInfo.running)
+    {
+        return;
+    }
+
+    // With pending cleared the interrupt leaves the shadow schedule alone
+    pwmInfo._pending = false;
+
+    uint8_t shadow = pwmInfo._active ^ 1;
+    pwm_build(&pwmInfo._schedules[shadow]);
+
+    if (pwmInfo._timerRunning)
+    {
+        pwmInfo._pending = true;
+    }
+    else
+    {
+        pwmInfo._active = shadow;
+        pwm_apply(&pwmInfo._schedules[shadow]);
+    }
+}
+
+int pwm_init(uint8_t npins, const uint8_t* pins, uint8_t reverse)
 {
     /* Assert number of pins is correct */
     if (npins > MAX_PWM_PINS)
     {
         debug("Incorrect number of PWM pins (%d)\n", npins);
-        return;
+        return -1;
+    }
+
+    /* Pins are driven through GPIO set/clear registers, GPIO16 is not there */
+    for (uint8_t i = 0; i < npins; ++i)
+    {
+        if (pins[i] >= 16)
+        {
+            debug("Incorrect PWM pin (%d)\n", pins[i]);
+            return -1;
+        }
     }
 
     /* Initialize */
     pwmInfo._maxLoad = 0;
-    pwmInfo._onLoad = 0;
-    pwmInfo._offLoad = 0;
-    pwmInfo._step = PERIOD_ON;
+    pwmInfo._allMask = 0;
+    pwmInfo._step = 0;
+    pwmInfo._period = 0;
+    pwmInfo._active = 0;
+    pwmInfo._pending = false;
+    pwmInfo._timerRunning = false;
     pwmInfo.reverse = reverse;
+    pwmInfo.dither = false;
 
     /* Save pins information */
     pwmInfo.usedPins = npins;
@@ -97,6 +366,8 @@ void pwm_init(uint8_t npins, const uint8_t* pins, uint8_t reverse)
     for (; i < npins; ++i)
     {
         pwmInfo.pins[i].pin = pins[i];
+        pwmInfo.pins[i].dutyCycle = 0;
+        pwmInfo._allMask |= BIT(pins[i]);
 
         /* configure GPIOs */
         gpio_enable(pins[i], GPIO_OUTPUT);
@@ -104,6 +375,8 @@ void pwm_init(uint8_t npins, const uint8_t* pins, uint8_t reverse)
 
     /* Stop timers and mask interrupts */
     pwm_stop();
+    timer_set_divider(FRC1, PWM_TIMER_DIVIDER);
+    timer_set_reload(FRC1, false);
 
     /* set up ISRs */
     _xt_isr_attach(INUM_TIMER_FRC1, frc1_interrupt_handler, NULL);
@@ -111,40 +384,76 @@ void pwm_init(uint8_t npins, const uint8_t* pins, uint8_t reverse)
     /* Flag not running */
     pwmInfo.running = 0;
     debug("PWM Init");
+    return 0;
 }
 
 void pwm_set_freq(uint16_t freq)
 {
-    /* Stop now to avoid load being used */
-    if (pwmInfo.running)
+    // Any 16 bit frequency fits 23 bit FRC1 load at this timer rate
+    if (!freq)
     {
-        pwm_stop();
-        pwmInfo.running = 1;
+        debug("Incorrect frequency (%u)", freq);
+        return;
     }
 
-    if (!timer_set_frequency(FRC1, freq))
+    pwmInfo._maxLoad = PWM_TIMER_FREQ / freq;
+    pwmInfo.freq = freq;
+    debug("Frequency set at %u",pwmInfo.freq);
+    debug("MaxLoad is %u",pwmInfo._maxLoad);
+
+    pwm_update();
+}
+
+int pwm_set_dither(bool dither)
+{
+#if PWM_DITHER_PERIODS == 1
+    // Printed without PWM_DEBUG too, the lowest duties are dark otherwise
+    if (dither)
     {
-        pwmInfo._maxLoad = timer_get_load(FRC1);
-        pwmInfo.freq = freq;
-        debug("Frequency set at %u",pwmInfo.freq);
-        debug("MaxLoad is %u",pwmInfo._maxLoad);
+        printf("PWM: dither needs PWM_DITHER_PERIODS above 1 at build time\n");
+        return -1;
     }
+#endif
 
-    if (pwmInfo.running)
+    pwmInfo.dither = dither;
+    debug("Dither %s", dither ? "on" : "off");
+    pwm_update();
+    return 0;
+}
+
+uint16_t pwm_get_min_duty()
+{
+    uint32_t periodLoad = pwmInfo._maxLoad * (pwmInfo.dither ? PWM_DITHER_PERIODS : 1);
+    if (!periodLoad)
     {
-        pwm_start();
+        return 0;
     }
+
+    // One PWM_MIN_LOAD pulse per pattern, rounded up
+    uint32_t duty = (PWM_MIN_LOAD * UINT16_MAX + periodLoad - 1) / periodLoad;
+    return (duty < UINT16_MAX) ? duty : UINT16_MAX;
 }
 
 void pwm_set_duty(uint16_t duty)
 {
-    pwmInfo.dutyCycle = duty;
-    if (duty == 0 || duty == UINT16_MAX)
+    for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
     {
-        pwmInfo.output = (duty == UINT16_MAX);
+        pwmInfo.pins[i].dutyCycle = duty;
     }
-    debug("Duty set at %u",pwmInfo.dutyCycle);
-    pwm_restart();
+    debug("Duty set at %u", duty);
+    pwm_update();
+}
+
+void pwm_set_channel_duty(uint8_t channel, uint16_t duty)
+{
+    if (channel >= pwmInfo.usedPins)
+    {
+        return;
+    }
+
+    pwmInfo.pins[channel].dutyCycle = duty;
+    debug("Duty of channel %u set at %u", channel, duty);
+    pwm_update();
 }
 
 void pwm_restart()
@@ -158,49 +467,29 @@ void pwm_restart()
 
 void pwm_start()
 {
-    pwmInfo._onLoad = pwmInfo.dutyCycle * pwmInfo._maxLoad / UINT16_MAX;
-    pwmInfo._offLoad = pwmInfo._maxLoad - pwmInfo._onLoad;
-    pwmInfo._step = PERIOD_ON;
-
-    if(!pwmInfo._onLoad)
-    {
-        debug("Can't set timer with low duty and frequency settings, put duty at 0");
-        pwmInfo.dutyCycle = 0;
-    }
+    timer_set_interrupts(FRC1, true);
+    pwmInfo.running = 1;
 
-    // 0% and 100% duty cycle are special cases: constant output.
-    if (pwmInfo.dutyCycle > 0 && pwmInfo.dutyCycle < UINT16_MAX)
-    {
-        // Trigger ON
-        uint8_t i = 0;
-        for (; i < pwmInfo.usedPins; ++i)
-        {
-            gpio_write(pwmInfo.pins[i].pin, pwmInfo.reverse ? false : true);
-        }
-        timer_set_load(FRC1, pwmInfo._onLoad);
-        timer_set_reload(FRC1, false);
-        timer_set_interrupts(FRC1, true);
-        timer_set_run(FRC1, true);
-    }
-    else
-    {
-        for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
-        {
-            gpio_write(pwmInfo.pins[i].pin, pwmInfo.reverse ? !pwmInfo.output : pwmInfo.output );
-        }       
-    }
+    // The timer may still run if already started, so this goes through
+    // the shadow schedule like any update
+    pwm_update();
     debug("PWM started");
-    pwmInfo.running = 1;
 }
 
 void pwm_stop()
 {
     timer_set_interrupts(FRC1, false);
     timer_set_run(FRC1, false);
-    for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
+    pwmInfo._timerRunning = false;
+    pwmInfo._pending = false;
+    if (pwmInfo.reverse)
     {
-        gpio_write(pwmInfo.pins[i].pin, pwmInfo.reverse ? true : false);
-    }       
+        GPIO.OUT_SET = pwmInfo._allMask;
+    }
+    else
+    {
+        GPIO.OUT_CLEAR = pwmInfo._allMask;
+    }
     debug("PWM stopped");
     pwmInfo.running = 0;
 }
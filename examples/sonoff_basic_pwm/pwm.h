@@ -9,6 +9,7 @@
 #define EXTRAS_PWM_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define MAX_PWM_PINS    8
 
@@ -21,23 +22,59 @@ extern "C" {
 /**
  * Initialize pwm
  * @param npins Number of pwm pin used
- * @param pins Array pointer to the pins
+ * @param pins Array pointer to the pins. GPIO16 is not supported, it is
+ *             not driven by the GPIO set/clear registers the timer uses
  * @param reverse If true, the pwm work in reverse mode
+ * @return 0 on success, -1 if there are over MAX_PWM_PINS pins or
+ *         one of them is GPIO16. PWM is left unconfigured then.
  */    
-void pwm_init(uint8_t npins, const uint8_t* pins, uint8_t reverse);
+int pwm_init(uint8_t npins, const uint8_t* pins, uint8_t reverse);
 
 /**
- * Set PWM frequency. If error, frequency not set
+ * Set PWM frequency. If error, frequency not set.
+ * Takes effect at the end of the current period.
  * @param freq PWM frequency value in Hertz
  */  
 void pwm_set_freq(uint16_t freq);
 
 /**
- * Set Duty between 0 and UINT16_MAX
+ * Enable dithered mode. On-times then alternate between adjacent
+ * timer loads over a pattern of PWM_DITHER_PERIODS periods, 16 of them
+ * add 4 bits of duty resolution and keep the lowest duties that would
+ * otherwise be too short for the timer. The pattern is sized at build
+ * time, e.g. EXTRA_CFLAGS += -DPWM_DITHER_PERIODS=16, and is 1 period
+ * by default, which can't dither. Takes effect at the end of the
+ * current period.
+ * @param dither If true, the pwm works in dithered mode
+ * @return 0 on success, -1 if dither is requested in a build with
+ *         PWM_DITHER_PERIODS of 1. Mode is left unchanged then.
+ */  
+int pwm_set_dither(bool dither);
+
+/**
+ * Smallest duty, from 0 or from UINT16_MAX, that still gives the pin
+ * pulses at the current frequency. Anything closer to the ends is
+ * constant output. Dithered mode spreads pulses over the pattern and
+ * lowers it by PWM_DITHER_PERIODS.
+ * @return Duty value, 0 if no frequency is set
+ */
+uint16_t pwm_get_min_duty();
+
+/**
+ * Set Duty of all channels between 0 and UINT16_MAX.
+ * Takes effect at the end of the current period.
  * @param duty Duty value
  */  
 void pwm_set_duty(uint16_t duty);
 
+/**
+ * Set Duty of one channel between 0 and UINT16_MAX.
+ * Takes effect at the end of the current period.
+ * @param channel Index of the pin in pins passed to pwm_init
+ * @param duty Duty value
+ */  
+void pwm_set_channel_duty(uint8_t channel, uint16_t duty);
+
 /**
  * Restart the pwm signal
  */  
@@ -0,0 +1,302 @@
+// Host test of the color component against the float code it replaced.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <color.h>
+#include "test.h"
+
+
+// Float HSI conversion of the examples before the color component, with
+// intensity as a 0-1 ratio instead of a shaped percentage. Not inlined, so
+// that the benchmark can't hoist cos() out of its loops.
+static __attribute__((noinline)) void float_hsi2rgb(int hue, int saturation, double intensity, int scale,
+                          int *lead, int *trail, int *rest) {
+    double h = (hue % 120) * M_PI / 180;
+    double s = saturation / 100.0;
+    double share = cos(h) / cos(M_PI / 3 - h);
+
+    *lead = scale * intensity / 3 * (1 + s * share);
+    *trail = scale * intensity / 3 * (1 + s * (1 - share));
+    *rest = scale * intensity / 3 * (1 - s);
+}
+
+
+static void float_hsi2rgbw(int hue, int saturation, double intensity, int scale,
+                           int *lead, int *trail, int *white) {
+    double h = (hue % 120) * M_PI / 180;
+    double s = saturation / 100.0;
+    double share = cos(h) / cos(M_PI / 3 - h);
+
+    *lead = s * scale * intensity / 3 * (1 + share);
+    *trail = s * scale * intensity / 3 * (1 + (1 - share));
+    *white = scale * (1 - s) * intensity;
+}
+
+
+// Channels of a result in the sector order of its hue
+static void sector_order(int hue, const color_rgbw_t *rgb, int *channels) {
+    int sector = (hue % 360) / 120;
+    const uint16_t c[3] = { rgb->red, rgb->green, rgb->blue };
+    for (int i = 0; i < 3; i++)
+        channels[i] = c[(sector + i) % 3];
+}
+
+
+static int max_error(int a, int b, int error) {
+    return abs(a - b) > error ? abs(a - b) : error;
+}
+
+
+static void test_hsi2rgb(uint16_t scale, int tolerance) {
+    int error = 0;
+
+    for (int hue = 0; hue < 360; hue++) {
+        for (int saturation = 0; saturation <= 100; saturation++) {
+            for (uint32_t intensity = 0; intensity <= COLOR_ONE; intensity += 64) {
+                color_rgbw_t rgb;
+                color_hsi2rgb(hue, saturation, intensity, scale, &rgb);
+
+                int got[3], want[3];
+                sector_order(hue, &rgb, got);
+                float_hsi2rgb(hue, saturation, (double)intensity / COLOR_ONE, scale,
+                              &want[0], &want[1], &want[2]);
+
+                for (int i = 0; i < 3; i++)
+                    error = max_error(got[i], want[i], error);
+                CHECK(rgb.white == 0);
+            }
+        }
+    }
+
+    printf("  hsi2rgb scale %5u: max error %d\n", scale, error);
+    CHECK(error <= tolerance);
+}
+
+
+static void test_hsi2rgbw(uint16_t scale, int tolerance) {
+    int error = 0;
+
+    for (int hue = 0; hue < 360; hue++) {
+        for (int saturation = 0; saturation <= 100; saturation++) {
+            for (uint32_t intensity = 0; intensity <= COLOR_ONE; intensity += 64) {
+                color_rgbw_t rgbw;
+                color_hsi2rgbw(hue, saturation, intensity, scale, &rgbw);
+
+                int got[3], want[3];
+                sector_order(hue, &rgbw, got);
+                float_hsi2rgbw(hue, saturation, (double)intensity / COLOR_ONE, scale,
+                               &want[0], &want[1], &want[2]);
+
+                error = max_error(got[0], want[0], error);
+                error = max_error(got[1], want[1], error);
+                error = max_error(rgbw.white, want[2], error);
+                CHECK(got[2] == 0);
+            }
+        }
+    }
+
+    printf("  hsi2rgbw scale %5u: max error %d\n", scale, error);
+    CHECK(error <= tolerance);
+}
+
+
+static void test_pixels_scale() {
+    // Every lane is rounded on its own, carries must not leak into the next
+    for (uint32_t level = 0; level <= 256; level++) {
+        for (uint32_t value = 0; value < 256; value++) {
+            uint32_t pixel = value | (255 - value) << 8 | value << 16 | (255 - value) << 24;
+            color_pixels_scale(&pixel, 1, level);
+
+            uint32_t a = (value * level + 128) >> 8;
+            uint32_t b = ((255 - value) * level + 128) >> 8;
+            if (level == 256)
+                a = value, b = 255 - value;
+            CHECK(pixel == (a | b << 8 | a << 16 | b << 24));
+        }
+    }
+}
+
+
+static void test_float_arguments() {
+    CHECK(color_hue(-10) == 0);
+    CHECK(color_hue(NAN) == 0);
+    CHECK(color_hue(119.5f) == 120);
+    CHECK(color_hue(1e9f) == 360);
+    CHECK(color_percent(-1) == 0);
+    CHECK(color_percent(NAN) == 0);
+    CHECK(color_percent(49.4f) == 49);
+    CHECK(color_percent(100.2f) == 100);
+    CHECK(color_percent(1e9f) == 100);
+
+    // 360 wraps to the color of 0
+    color_rgbw_t a, b;
+    color_hsi2rgb(color_hue(360), 100, COLOR_ONE, 255, &a);
+    color_hsi2rgb(0, 100, COLOR_ONE, 255, &b);
+    CHECK(a.red == b.red && a.green == b.green && a.blue == b.blue);
+}
+
+
+static double now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+
+// Host time per conversion, the host has an FPU and a divider, the ESP8266
+// emulates both, so this understates the gain on the device
+static void benchmark_hsi2rgb(uint16_t scale) {
+    const int rounds = 20;
+    volatile uint32_t sink = 0;
+    int conversions = 0;
+
+    double start = now_ns();
+    for (int round = 0; round < rounds; round++) {
+        for (int hue = 0; hue < 360; hue += 3) {
+            for (int saturation = 0; saturation <= 100; saturation += 5) {
+                for (uint32_t intensity = 0; intensity <= COLOR_ONE; intensity += 256) {
+                    int lead, trail, rest;
+                    float_hsi2rgb(hue, saturation, (double)intensity / COLOR_ONE, scale,
+                                  &lead, &trail, &rest);
+                    sink += lead + trail + rest;
+                    conversions++;
+                }
+            }
+        }
+    }
+    double float_ns = (now_ns() - start) / conversions;
+
+    start = now_ns();
+    for (int round = 0; round < rounds; round++) {
+        for (int hue = 0; hue < 360; hue += 3) {
+            for (int saturation = 0; saturation <= 100; saturation += 5) {
+                for (uint32_t intensity = 0; intensity <= COLOR_ONE; intensity += 256) {
+                    color_rgbw_t rgb;
+                    color_hsi2rgb(hue, saturation, intensity, scale, &rgb);
+                    sink += rgb.red + rgb.green + rgb.blue;
+                }
+            }
+        }
+    }
+    double integer_ns = (now_ns() - start) / conversions;
+
+    printf("  hsi2rgb scale %5u: float %.1f ns, integer %.1f ns per color\n",
+           scale, float_ns, integer_ns);
+}
+
+
+// Per-pixel conversion and scaling the strip examples did before
+// color_hsi2pixels() and color_pixels_scale()
+static void scalar_hsi2pixels(const color_hsi_t *colors, uint32_t *pixels, size_t count) {
+    for (size_t n = 0; n < count; n++) {
+        color_rgbw_t rgb;
+        color_hsi2rgb(colors[n].hue, colors[n].saturation, colors[n].intensity, 255, &rgb);
+        pixels[n] = rgb.red << 16 | rgb.green << 8 | rgb.blue;
+    }
+}
+
+
+static void scalar_pixels_scale(uint32_t *pixels, size_t count, uint16_t level) {
+    for (size_t n = 0; n < count; n++) {
+        uint32_t pixel = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+            pixel |= ((((pixels[n] >> shift) & 0xff) * level + 128) >> 8) << shift;
+        pixels[n] = pixel;
+    }
+}
+
+
+static void benchmark_pixels(size_t count) {
+    static color_hsi_t colors[1000];
+    static uint32_t pixels[1000];
+    const int frames = 2000000 / count;
+
+    // A rainbow at full saturation with a fading tail, like the effects
+    for (size_t n = 0; n < count; n++) {
+        colors[n].hue = n * 360 / count;
+        colors[n].saturation = 100;
+        colors[n].intensity = COLOR_ONE - n * COLOR_ONE / count;
+    }
+
+    double start = now_ns();
+    for (int frame = 0; frame < frames; frame++)
+        scalar_hsi2pixels(colors, pixels, count);
+    double scalar_convert = (now_ns() - start) / 1e9;
+
+    start = now_ns();
+    for (int frame = 0; frame < frames; frame++)
+        color_hsi2pixels(colors, pixels, count);
+    double convert = (now_ns() - start) / 1e9;
+
+    start = now_ns();
+    for (int frame = 0; frame < frames; frame++)
+        scalar_pixels_scale(pixels, count, 255);
+    double scalar_scale = (now_ns() - start) / 1e9;
+
+    start = now_ns();
+    for (int frame = 0; frame < frames; frame++)
+        color_pixels_scale(pixels, count, 255);
+    double scale = (now_ns() - start) / 1e9;
+
+    double total = (double)frames * count / 1e6;
+    printf("  %4zu leds: hsi2pixels %.0f / per pixel %.0f, "
+           "pixels_scale %.0f / per channel %.0f Mpixels/s\n",
+           count, total / convert, total / scalar_convert,
+           total / scale, total / scalar_scale);
+}
+
+
+static void test_hsi2pixels(int tolerance) {
+    int error = 0;
+
+    for (int hue = 0; hue < 720; hue++) {
+        for (int saturation = 0; saturation <= 100; saturation++) {
+            color_hsi_t colors[COLOR_ONE / 64 + 1];
+            uint32_t pixels[COLOR_ONE / 64 + 1];
+            size_t count = 0;
+
+            for (uint32_t intensity = 0; intensity <= COLOR_ONE; intensity += 64) {
+                colors[count].hue = hue;
+                colors[count].saturation = saturation;
+                colors[count].intensity = intensity;
+                count++;
+            }
+            color_hsi2pixels(colors, pixels, count);
+
+            for (size_t n = 0; n < count; n++) {
+                color_rgbw_t rgb;
+                color_hsi2rgb(hue, saturation, colors[n].intensity, 255, &rgb);
+
+                error = max_error((pixels[n] >> 16) & 0xff, rgb.red, error);
+                error = max_error((pixels[n] >> 8) & 0xff, rgb.green, error);
+                error = max_error(pixels[n] & 0xff, rgb.blue, error);
+                CHECK((pixels[n] >> 24) == 0);
+            }
+        }
+    }
+
+    printf("  hsi2pixels: max error %d\n", error);
+    CHECK(error <= tolerance);
+}
+
+
+int main() {
+    test_hsi2rgb(255, 1);
+    test_hsi2rgb(4095, 1);
+    test_hsi2rgb(0xffff, 1);
+    test_hsi2rgbw(255, 1);
+    test_hsi2rgbw(4095, 1);
+    test_hsi2rgbw(0xffff, 1);
+    test_hsi2pixels(1);
+    test_pixels_scale();
+    test_float_arguments();
+    benchmark_hsi2rgb(255);
+    benchmark_hsi2rgb(0xffff);
+    benchmark_pixels(60);
+    benchmark_pixels(300);
+    benchmark_pixels(1000);
+
+    return test_result();
+}
@@ -0,0 +1,132 @@
+/*
+ * Checks the fixed point fire kernel of the fireplace example against
+ * the divide based one it replaced: exact divisions over the heat range,
+ * the paired saturating subtract and the heat distribution of a long run.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+#include "fire.c"
+
+#define FRAMES 20000
+#define WARMUP 100
+
+// Kernel as it was before, one unsigned int per cell and plain divides
+static unsigned int stack[FIRE_WIDTH][FIRE_HEIGHT];
+
+static void reference_update(unsigned int hot) {
+    unsigned int maxhot = hot * FIRE_HEIGHT;
+
+    for (int i = 0; i < FIRE_WIDTH; i++) {
+        for (int j = 0; j < FIRE_HEIGHT; j++) {
+            unsigned int cooling = hwrand() % FIRE_COOLING;
+            stack[i][j] = (stack[i][j] < cooling) ? 0 : stack[i][j] - cooling;
+        }
+
+        if (stack[i][0] < hot) {
+            stack[i][0] = hot + hwrand() % (maxhot - hot);
+        }
+    }
+
+    for (int i = 0; i < FIRE_WIDTH; i++) {
+        for (int j = FIRE_HEIGHT-1; j > 0; j--) {
+            unsigned long sum = stack[i][j] + stack[i][j-1];
+            if (i > 0)
+                sum += stack[i-1][j-1];
+            if (i < FIRE_WIDTH-1)
+                sum += stack[i+1][j-1];
+
+            stack[i][j] = sum / 6;
+        }
+    }
+}
+
+static uint8_t reference_index(int x, int y) {
+    return stack[x][y] / FIRE_HEIGHT * 2;
+}
+
+static void test_divisions() {
+    for (uint32_t x = 0; x < 256 * FIRE_HEIGHT; x++)
+        CHECK(((x * FIRE_HEAT_DIV) >> FIRE_HEAT_DIV_SHIFT) == x / FIRE_HEIGHT);
+
+    for (uint32_t x = 0; x < 1024 * FIRE_HEIGHT; x++)
+        CHECK(((x * FIRE_SPREAD_DIV) >> FIRE_SPREAD_DIV_SHIFT) == x / 6);
+}
+
+static void test_sub_pairs() {
+    // Cells are below 0x8000, cooling below FIRE_COOLING
+    for (uint32_t a = 0; a < 0x8000; a++) {
+        uint32_t b = (a * 40503) & 0x7fff;
+        for (uint32_t c = 0; c < FIRE_COOLING; c++) {
+            uint32_t e = FIRE_COOLING - 1 - c;
+
+            uint32_t d = sub_pairs(a | (b << 16), c | (e << 16));
+            CHECK((d & 0xffff) == ((a < c) ? 0 : a - c));
+            CHECK((d >> 16) == ((b < e) ? 0 : b - e));
+        }
+    }
+}
+
+typedef void (*update_fn)(unsigned int hot);
+typedef uint8_t (*index_fn)(int x, int y);
+
+static void run(update_fn update, index_fn index, unsigned int hot, double *histogram) {
+    for (int i = 0; i < 256; i++)
+        histogram[i] = 0;
+
+    for (int frame = 0; frame < WARMUP; frame++)
+        update(hot);
+
+    for (int frame = 0; frame < FRAMES; frame++) {
+        update(hot);
+        for (int x = 0; x < FIRE_WIDTH; x++)
+            for (int y = 0; y < FIRE_HEIGHT; y++)
+                histogram[index(x, y)] += 1.0 / (FRAMES * NUM_CELLS);
+    }
+}
+
+// Host time of the kernel alone, the ESP8266 has no divide instruction,
+// so this understates the gain on the device
+static double seconds(update_fn update, unsigned int hot) {
+    clock_t start = clock();
+    for (int frame = 0; frame < 10 * FRAMES; frame++)
+        update(hot);
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void test_distribution(unsigned int hot) {
+    static double histogram[256], reference_histogram[256];
+
+    memset(&heat, 0, sizeof(heat));
+    memset(stack, 0, sizeof(stack));
+
+    run(fire_update, fire_palette_index, hot, histogram);
+    run(reference_update, reference_index, hot, reference_histogram);
+
+    double l1 = 0;
+    for (int i = 0; i < 256; i++)
+        l1 += fabs(histogram[i] - reference_histogram[i]);
+
+    double cells = 10.0 * FRAMES * NUM_CELLS / 1e6;
+    double fire_rate = cells / seconds(fire_update, hot);
+    double reference_rate = cells / seconds(reference_update, hot);
+
+    printf("  fire %dx%d hot %u: histogram L1 %.4f, %.0f Mcells/s, "
+           "reference %.0f Mcells/s (%.1fx)\n",
+           FIRE_WIDTH, FIRE_HEIGHT, hot, l1, fire_rate, reference_rate,
+           fire_rate / reference_rate);
+    CHECK(l1 < 0.02);
+}
+
+int main() {
+    test_divisions();
+    test_sub_pairs();
+    test_distribution(128);
+    test_distribution(256);
+
+    return test_result();
+}
@@ -0,0 +1,110 @@
+/*
+ * Replays edge timelines through the gesture recognizer, ticking it
+ * whenever it asks to, and checks the gestures it reports and when.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "gesture.h"
+
+static const char *names[] = {
+    "SINGLE", "DOUBLE", "TRIPLE", "LONG", "HOLD", "ON", "OFF",
+};
+
+static char reported[256];
+
+static void emit(gesture_t gesture, void *context) {
+    char text[32];
+    snprintf(text, sizeof(text), "%s%s@%u", reported[0] ? " " : "",
+             names[gesture], *(uint32_t *)context);
+    strncat(reported, text, sizeof(reported) - strlen(reported) - 1);
+}
+
+/* Timeline is pairs of edge time and level after it, replayed until
+ * end_ms. Returns gestures as "NAME@time" separated by spaces. */
+static const char *replay(const gesture_config_t *config, uint8_t level,
+                          const uint32_t *timeline, int edges, uint32_t end_ms) {
+    gesture_state_t state;
+    uint32_t now = 0;
+    uint32_t wait = GESTURE_IDLE;
+
+    reported[0] = 0;
+    gesture_init(&state, config, level, now);
+
+    for (int i = 0; i <= edges; i++) {
+        uint32_t edge_ms = (i < edges) ? timeline[2 * i] : end_ms;
+
+        // Ticks it asked for before the next edge
+        while (wait != GESTURE_IDLE && now + wait <= edge_ms) {
+            now += wait;
+            wait = gesture_tick(&state, level, now, emit, &now);
+        }
+        if (i == edges)
+            break;
+
+        now = edge_ms;
+        level = timeline[2 * i + 1];
+        gesture_edge(&state, level, now, emit, &now);
+        wait = gesture_tick(&state, level, now, emit, &now);
+    }
+
+    return reported;
+}
+
+#define CHECK_REPLAY(config, level, expected, ...) do { \
+    const uint32_t timeline[] = { __VA_ARGS__ }; \
+    const char *result = replay(&(config), level, timeline, \
+                                sizeof(timeline) / sizeof(*timeline) / 2, 5000); \
+    if (strcmp(result, expected)) \
+        printf("  %s: got \"%s\"\n", #__VA_ARGS__, result); \
+    CHECK(!strcmp(result, expected)); \
+} while (0)
+
+static void test_button() {
+    gesture_config_t config = GESTURE_CONFIG_BUTTON(1000);
+
+    CHECK_REPLAY(config, 1, "SINGLE@300", 100, 0, 300, 1);
+    // Bounces on press and release
+    CHECK_REPLAY(config, 1, "SINGLE@300", 100, 0, 105, 1, 110, 0, 300, 1, 303, 0, 304, 1);
+    CHECK_REPLAY(config, 1, "LONG@1100", 100, 0, 1500, 1);
+    // Release within debounce time is taken once it has settled
+    CHECK_REPLAY(config, 1, "SINGLE@150", 100, 0, 120, 1);
+}
+
+static void test_presses() {
+    gesture_config_t config = GESTURE_CONFIG_BUTTON(1000);
+    config.max_presses = 3;
+    config.repeat_ms = 300;
+
+    CHECK_REPLAY(config, 1, "SINGLE@600", 100, 0, 200, 1);
+    CHECK_REPLAY(config, 1, "DOUBLE@900", 100, 0, 200, 1, 400, 0, 500, 1);
+    // Same with bounces on every press and release
+    CHECK_REPLAY(config, 1, "DOUBLE@900", 100, 0, 104, 1, 106, 0, 200, 1, 203, 0, 205, 1,
+                 400, 0, 402, 1, 404, 0, 500, 1, 501, 0, 503, 1);
+    CHECK_REPLAY(config, 1, "TRIPLE@800", 100, 0, 200, 1, 400, 0, 500, 1, 700, 0, 800, 1);
+    // Pause longer than the press window
+    CHECK_REPLAY(config, 1, "SINGLE@600 SINGLE@1200", 100, 0, 200, 1, 700, 0, 800, 1);
+    CHECK_REPLAY(config, 1, "LONG@1400 HOLD@1700 HOLD@2000", 100, 0, 200, 1, 400, 0, 2000, 1);
+}
+
+static void test_toggle() {
+    gesture_config_t config = GESTURE_CONFIG_TOGGLE(0);
+    gesture_config_t filtered = GESTURE_CONFIG_TOGGLE_FILTERED(0);
+
+    CHECK_REPLAY(config, 1, "ON@100 OFF@500", 100, 0, 110, 1, 120, 0, 500, 1, 505, 0, 510, 1);
+    // Glitch that settles back
+    CHECK_REPLAY(config, 1, "ON@100 OFF@150", 100, 0, 110, 1);
+
+    CHECK_REPLAY(filtered, 1, "ON@150", 100, 0);
+    CHECK_REPLAY(filtered, 1, "", 100, 0, 120, 1);
+    CHECK_REPLAY(filtered, 1, "ON@150 OFF@2050", 100, 0, 102, 1, 104, 0, 106, 1, 108, 0, 2000, 1);
+}
+
+int main() {
+    test_button();
+    test_presses();
+    test_toggle();
+
+    return test_result();
+}
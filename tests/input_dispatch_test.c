@@ -0,0 +1,196 @@
+/*
+ * Checks input_dispatch on the host: attach and detach rules, and that
+ * edges reach the handler of their GPIO through the ring and the input
+ * task. Also times an edge against the linked list lookup the drivers
+ * used before, the table cost should not grow with the number of inputs.
+ */
+#include <setjmp.h>
+#include <time.h>
+
+#include <task.h>
+
+#include "test.h"
+#include "input_dispatch.c"
+
+static TaskFunction_t task_function;
+static jmp_buf task_exit;
+static int task_takes;
+static TickType_t ticks;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint16_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *task) {
+    task_function = function;
+    *task = &task_function;
+    return pdPASS;
+}
+
+TickType_t xTaskGetTickCount(void) { return ticks; }
+TickType_t xTaskGetTickCountFromISR(void) { return ticks; }
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {}
+
+// Input task handles one wake up, then waits again and leaves
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait) {
+    if (task_takes++)
+        longjmp(task_exit, 1);
+    return 1;
+}
+
+static void run_task() {
+    task_takes = 0;
+    if (!setjmp(task_exit))
+        task_function(NULL);
+}
+
+static void edge(uint8_t gpio_num, bool level) {
+    if (level)
+        GPIO.IN |= BIT(gpio_num);
+    else
+        GPIO.IN &= ~BIT(gpio_num);
+
+    if (gpio_interrupt_handlers[gpio_num])
+        gpio_interrupt_handlers[gpio_num](gpio_num);
+}
+
+typedef struct {
+    uint32_t calls;
+    input_event_t last;
+} input_t;
+
+static input_t inputs[INPUT_DISPATCH_GPIO_COUNT];
+
+static void handler(const input_event_t *event, void *context) {
+    input_t *input = context;
+    input->calls++;
+    input->last = *event;
+}
+
+static void other_handler(const input_event_t *event, void *context) {}
+
+static void test_attach() {
+    CHECK(input_dispatch_attach(17, GPIO_INTTYPE_EDGE_ANY, handler, &inputs[0]) < 0);
+    CHECK(input_dispatch_attach(16, GPIO_INTTYPE_EDGE_ANY, handler, &inputs[16]) < 0);
+    CHECK(input_dispatch_attach(4, GPIO_INTTYPE_EDGE_ANY, NULL, &inputs[4]) < 0);
+
+    CHECK(input_dispatch_attach(16, GPIO_INTTYPE_NONE, handler, &inputs[16]) == 0);
+    CHECK(input_dispatch_attach(4, GPIO_INTTYPE_EDGE_ANY, handler, &inputs[4]) == 0);
+    CHECK(input_dispatch_attach(4, GPIO_INTTYPE_EDGE_ANY, other_handler, NULL) < 0);
+    CHECK(gpio_interrupt_handlers[4] != NULL);
+
+    ticks = 7;
+    edge(4, 1);
+    edge(4, 0);
+    run_task();
+    CHECK(inputs[4].calls == 2);
+    CHECK(inputs[4].last.gpio_num == 4);
+    CHECK(inputs[4].last.level == 0);
+    CHECK(inputs[4].last.time == 7);
+
+    // Edges still queued for a detached GPIO are dropped
+    edge(4, 1);
+    CHECK(input_dispatch_detach(4, other_handler) == NULL);
+    CHECK(input_dispatch_detach(4, handler) == &inputs[4]);
+    CHECK(input_dispatch_detach(4, handler) == NULL);
+    CHECK(gpio_interrupt_handlers[4] == NULL);
+    run_task();
+    CHECK(inputs[4].calls == 2);
+
+    CHECK(input_dispatch_detach(16, handler) == &inputs[16]);
+}
+
+static void test_overflow() {
+    CHECK(input_dispatch_attach(5, GPIO_INTTYPE_EDGE_ANY, handler, &inputs[5]) == 0);
+    uint32_t overflows = input_dispatch_get_stats()->overflows;
+
+    // Queue fills up, the last edge seen is lost
+    for (int i = 0; i < INPUT_DISPATCH_QUEUE_SIZE + 9; i++)
+        edge(5, i & 1);
+    CHECK(input_dispatch_get_stats()->overflows == overflows + 9);
+
+    run_task();
+    CHECK(inputs[5].calls == INPUT_DISPATCH_QUEUE_SIZE + 1);
+    CHECK(inputs[5].last.overflow);
+    CHECK(inputs[5].last.level == 0);
+
+    // Cleared once reported
+    inputs[5].calls = 0;
+    edge(5, 1);
+    run_task();
+    CHECK(inputs[5].calls == 1);
+    CHECK(!inputs[5].last.overflow);
+
+    input_dispatch_detach(5, handler);
+    inputs[5].calls = 0;
+}
+
+// The lookup drivers did in the interrupt before: walk a linked list of
+// their inputs for the GPIO
+typedef struct list_input {
+    uint8_t gpio_num;
+    input_t input;
+    struct list_input *next;
+} list_input_t;
+
+static list_input_t list_inputs[16];
+static list_input_t *list_head;
+
+static __attribute__((noinline)) void list_dispatch(uint8_t gpio_num) {
+    list_input_t *input = list_head;
+    while (input && input->gpio_num != gpio_num)
+        input = input->next;
+
+    if (input) {
+        input_event_t event = { ticks, gpio_num, gpio_read(gpio_num) };
+        handler(&event, &input->input);
+    }
+}
+
+static double now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+static void benchmark(uint8_t count) {
+    const int batches = 200000;
+    const int batch = INPUT_DISPATCH_QUEUE_SIZE;
+
+    // First registered input is last in the list, the worst case
+    list_head = NULL;
+    for (uint8_t i = 0; i < count; i++) {
+        list_inputs[i].gpio_num = i;
+        list_inputs[i].next = list_head;
+        list_head = &list_inputs[i];
+        CHECK(input_dispatch_attach(i, GPIO_INTTYPE_EDGE_ANY, handler, &inputs[i]) == 0);
+    }
+
+    double start = now_ns();
+    for (int i = 0; i < batches * batch; i++)
+        list_dispatch(0);
+    double list_ns = (now_ns() - start) / (batches * batch);
+
+    start = now_ns();
+    for (int i = 0; i < batches; i++) {
+        for (int j = 0; j < batch; j++)
+            gpio_interrupt_handlers[0](0);
+        run_task();
+    }
+    double table_ns = (now_ns() - start) / (batches * batch);
+
+    CHECK(inputs[0].calls == batches * batch);
+    printf("  %2u inputs: list lookup %.1f ns, table with queue %.1f ns per edge\n",
+           count, list_ns, table_ns);
+
+    for (uint8_t i = 0; i < count; i++) {
+        input_dispatch_detach(i, handler);
+        inputs[i].calls = 0;
+    }
+}
+
+int main() {
+    test_attach();
+    test_overflow();
+    benchmark(1);
+    benchmark(16);
+
+    return test_result();
+}
@@ -0,0 +1,167 @@
+// Host test of the LED matrix index map against a picture of the strip
+// built by walking it pixel by pixel. y grows upwards as in the fire
+// effect, rotations turn the picture clockwise.
+
+#include <stdio.h>
+#include <string.h>
+#include <led_matrix.h>
+#include "test.h"
+
+#define MAX_SIZE 64
+
+// x,y of the n-th cell of a width x height grid, ordered as given
+static void grid_position(uint16_t n, uint16_t width, uint16_t height,
+                          led_matrix_order_t order, bool serpentine,
+                          uint16_t *x, uint16_t *y) {
+    if (order == LED_MATRIX_ROWS) {
+        *y = n / width;
+        *x = n % width;
+        if (serpentine && (*y & 1))
+            *x = width - 1 - *x;
+    } else {
+        *x = n / height;
+        *y = n % height;
+        if (serpentine && (*x & 1))
+            *y = height - 1 - *y;
+    }
+}
+
+static void check_layout(const led_matrix_layout_t *layout) {
+    static uint16_t picture[MAX_SIZE][MAX_SIZE], turned[MAX_SIZE][MAX_SIZE];
+    uint8_t panels_x = layout->panels_x ? layout->panels_x : 1;
+    uint8_t panels_y = layout->panels_y ? layout->panels_y : 1;
+    uint16_t panel_size = layout->panel_width * layout->panel_height;
+    uint16_t width = layout->panel_width * panels_x;
+    uint16_t height = layout->panel_height * panels_y;
+    uint16_t count = width * height;
+
+    // Physical picture, picture[y][x] is the strip index shown there
+    for (uint16_t n = 0; n < count; n++) {
+        uint16_t panel_x, panel_y, x, y;
+        grid_position(n / panel_size, panels_x, panels_y,
+                      layout->panel_order, layout->panel_serpentine, &panel_x, &panel_y);
+        grid_position(n % panel_size, layout->panel_width, layout->panel_height,
+                      layout->order, layout->serpentine, &x, &y);
+        picture[panel_y * layout->panel_height + y][panel_x * layout->panel_width + x] = n;
+    }
+
+    // Quarter turns clockwise, (x, y) goes to (y, width - 1 - x)
+    for (int turn = 0; turn < layout->rotation; turn++) {
+        for (uint16_t y = 0; y < height; y++)
+            for (uint16_t x = 0; x < width; x++)
+                turned[width - 1 - x][y] = picture[y][x];
+
+        uint16_t swap = width;
+        width = height;
+        height = swap;
+        memcpy(picture, turned, sizeof(picture));
+    }
+
+    led_matrix_t matrix;
+    CHECK(led_matrix_init(&matrix, layout) == 0);
+    CHECK(matrix.width == width && matrix.height == height);
+    CHECK(led_matrix_count(&matrix) == count);
+
+    uint8_t seen[MAX_SIZE * MAX_SIZE] = { 0 };
+    for (uint16_t y = 0; y < height; y++) {
+        for (uint16_t x = 0; x < width; x++) {
+            uint16_t px = layout->mirror_x ? width - 1 - x : x;
+            uint16_t py = layout->mirror_y ? height - 1 - y : y;
+            uint16_t index = led_matrix_index(&matrix, x, y);
+
+            CHECK(index == picture[py][px]);
+            CHECK(index < count && !seen[index]);
+            if (index < count)
+                seen[index] = 1;
+        }
+    }
+
+    led_matrix_done(&matrix);
+    CHECK(matrix.map == NULL);
+}
+
+// Every orientation of every pixel order on one panel size and tiling
+static int check_orientations(led_matrix_layout_t layout) {
+    int layouts = 0;
+
+    for (int order = LED_MATRIX_ROWS; order <= LED_MATRIX_COLUMNS; order++) {
+        for (int serpentine = 0; serpentine < 2; serpentine++) {
+            for (int rotation = LED_MATRIX_ROTATE_0; rotation <= LED_MATRIX_ROTATE_270; rotation++) {
+                for (int mirror = 0; mirror < 4; mirror++) {
+                    layout.order = order;
+                    layout.serpentine = serpentine;
+                    layout.rotation = rotation;
+                    layout.mirror_x = mirror & 1;
+                    layout.mirror_y = mirror & 2;
+                    check_layout(&layout);
+                    layouts++;
+                }
+            }
+        }
+    }
+
+    return layouts;
+}
+
+static void test_single_panel() {
+    const uint16_t sizes[][2] = { { 1, 1 }, { 1, 7 }, { 6, 10 }, { 5, 5 }, { 8, 3 } };
+    int layouts = 0;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        led_matrix_layout_t layout = {
+            .panel_width = sizes[i][0],
+            .panel_height = sizes[i][1],
+        };
+        layouts += check_orientations(layout);
+    }
+
+    printf("  single panel: %d layouts\n", layouts);
+}
+
+static void test_tiling() {
+    const uint8_t tilings[][2] = { { 1, 1 }, { 2, 1 }, { 1, 3 }, { 2, 3 }, { 3, 2 } };
+    int layouts = 0;
+
+    for (size_t i = 0; i < sizeof(tilings) / sizeof(tilings[0]); i++) {
+        for (int order = LED_MATRIX_ROWS; order <= LED_MATRIX_COLUMNS; order++) {
+            for (int serpentine = 0; serpentine < 2; serpentine++) {
+                led_matrix_layout_t layout = {
+                    .panel_width = 4,
+                    .panel_height = 3,
+                    .panels_x = tilings[i][0],
+                    .panels_y = tilings[i][1],
+                    .panel_order = order,
+                    .panel_serpentine = serpentine,
+                };
+                layouts += check_orientations(layout);
+            }
+        }
+    }
+
+    printf("  tiled panels: %d layouts\n", layouts);
+}
+
+// The fireplace strip: columns from the bottom, every other one going down
+static void test_fireplace() {
+    const led_matrix_layout_t layout = {
+        .panel_width = 6, .panel_height = 10,
+        .order = LED_MATRIX_COLUMNS, .serpentine = true,
+    };
+    led_matrix_t matrix;
+
+    CHECK(led_matrix_init(&matrix, &layout) == 0);
+    CHECK(led_matrix_index(&matrix, 0, 0) == 0);
+    CHECK(led_matrix_index(&matrix, 0, 9) == 9);
+    CHECK(led_matrix_index(&matrix, 1, 9) == 10);
+    CHECK(led_matrix_index(&matrix, 1, 0) == 19);
+    CHECK(led_matrix_index(&matrix, 5, 0) == 59);
+    led_matrix_done(&matrix);
+}
+
+int main() {
+    test_single_panel();
+    test_tiling();
+    test_fireplace();
+
+    return test_result();
+}
@@ -0,0 +1,233 @@
+/*
+ * Checks the PWM driver of the sonoff_basic_pwm example: edges built
+ * for a period and the output of a simulated FRC1 interrupt.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "pwm.c"
+
+static uint32_t random_state = 1;
+
+static uint32_t random32() {
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 8;
+}
+
+// On-time of a pin in ticks, as played by the edges of one period
+static uint32_t edges_on_time(const PWMEdge *edges, uint8_t count, uint32_t mask) {
+    if (!(edges[0].set & mask))
+        return 0;
+
+    uint32_t time = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        if (i > 0 && (edges[i].clear & mask))
+            return time;
+        time += edges[i].load;
+    }
+    return time;
+}
+
+static void test_init() {
+    uint8_t pins[MAX_PWM_PINS + 1] = { 0, 1, 2, 3, 4, 5, 12, 13, 14 };
+
+    CHECK(pwm_init(MAX_PWM_PINS, pins, false) == 0);
+    CHECK(pwm_init(MAX_PWM_PINS + 1, pins, false) == -1);
+
+    pins[1] = 16;
+    CHECK(pwm_init(2, pins, false) == -1);
+}
+
+static void test_build_edges() {
+    const uint16_t freqs[] = { 100, 440, 1000, 5000, 20000 };
+    uint32_t max_error = 0;
+
+    for (int run = 0; run < 200000; run++) {
+        uint32_t maxLoad = PWM_TIMER_FREQ / freqs[run % 5];
+        uint8_t npins = 1 + random32() % MAX_PWM_PINS;
+
+        PWMPin pins[MAX_PWM_PINS];
+        uint32_t loads[MAX_PWM_PINS];
+        for (uint8_t i = 0; i < npins; ++i) {
+            pins[i].pin = (run + i * 3) % 16;
+            if (i > 0 && pins[i].pin == pins[0].pin)
+                pins[i].pin = (pins[i].pin + 1) % 16;
+
+            // Cluster some loads around each other and the period ends
+            switch (random32() % 4) {
+            case 0: loads[i] = random32() % (2 * PWM_MIN_LOAD); break;
+            case 1: loads[i] = maxLoad - random32() % (2 * PWM_MIN_LOAD); break;
+            case 2: loads[i] = i ? loads[i - 1] + random32() % (2 * PWM_MIN_LOAD) : 0; break;
+            default: loads[i] = random32() % (maxLoad + 1);
+            }
+            if (loads[i] > maxLoad)
+                loads[i] = maxLoad;
+        }
+        // Pins with the same number make no sense
+        for (uint8_t i = 0; i < npins; ++i)
+            for (uint8_t j = 0; j < i; ++j)
+                if (pins[i].pin == pins[j].pin)
+                    npins = i;
+
+        PWMEdge edges[MAX_PWM_PINS + 1];
+        uint8_t count = pwm_build_edges(edges, pins, loads, npins, maxLoad, false);
+
+        // Edges are ordered, far enough apart and add up to the period
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < count; ++i) {
+            CHECK(count == 1 || edges[i].load >= PWM_MIN_LOAD);
+            total += edges[i].load;
+        }
+        CHECK(total == maxLoad);
+
+        for (uint8_t i = 0; i < npins; ++i) {
+            uint32_t mask = BIT(pins[i].pin);
+            CHECK(!(edges[0].set & mask) != !(edges[0].clear & mask));
+
+            uint32_t on = edges_on_time(edges, count, mask);
+            uint32_t error = (on > loads[i]) ? on - loads[i] : loads[i] - on;
+            CHECK(error < PWM_MIN_LOAD);
+            if (error > max_error)
+                max_error = error;
+        }
+    }
+
+    printf("  edges: max on-time error %u ticks\n", max_error);
+}
+
+/* Runs the interrupt for whole periods from the start of one, returns
+ * the on-time of each pin over them */
+static void simulate(uint32_t *level, uint32_t periods, uint64_t *on) {
+    for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
+        on[i] = 0;
+
+    uint64_t end = (uint64_t)periods * pwmInfo._maxLoad;
+    for (uint64_t time = 0; time < end; ) {
+        *level = (*level | GPIO.OUT_SET) & ~GPIO.OUT_CLEAR;
+        GPIO.OUT_SET = GPIO.OUT_CLEAR = 0;
+
+        // Constant output, nothing to wait for
+        uint32_t step = frc1.run ? frc1.load : end - time;
+        for (uint8_t i = 0; i < pwmInfo.usedPins; ++i)
+            if (*level & BIT(pwmInfo.pins[i].pin))
+                on[i] += step;
+
+        time += step;
+        if (frc1.run)
+            frc1.handler(NULL);
+    }
+}
+
+static void test_output(bool dither, uint32_t periods, uint32_t tolerance) {
+    const uint8_t pins[] = { 4, 5, 12, 13 };
+    uint32_t level = 0;
+    uint64_t on[4];
+    uint64_t max_error = 0;
+
+    pwm_init(4, pins, false);
+    pwm_set_freq(1000);
+    CHECK(pwm_set_dither(dither) == 0);
+    pwm_start();
+
+    for (uint32_t duty = 0; duty <= UINT16_MAX; duty += 97) {
+        for (uint8_t i = 0; i < 4; ++i)
+            pwm_set_channel_duty(i, (duty + i * 16411) & UINT16_MAX);
+
+        // Update is latched at the end of the running period
+        simulate(&level, 1, on);
+        simulate(&level, periods, on);
+
+        for (uint8_t i = 0; i < 4; ++i) {
+            uint64_t target = (uint64_t)pwmInfo.pins[i].dutyCycle * pwmInfo._maxLoad * periods / UINT16_MAX;
+            uint64_t error = (on[i] > target) ? on[i] - target : target - on[i];
+            CHECK(error <= tolerance);
+            if (error > max_error)
+                max_error = error;
+        }
+    }
+
+    pwm_stop();
+    printf("  %s output: max on-time error %u ticks over %u periods\n",
+           dither ? "dithered" : "plain", (uint32_t)max_error, periods);
+}
+
+static void test_start_running() {
+    const uint8_t pins[] = { 4, 5 };
+    uint32_t level = 0;
+    uint64_t on[2];
+
+    pwm_init(2, pins, false);
+    pwm_set_freq(1000);
+    pwm_set_duty(UINT16_MAX / 3);
+    pwm_start();
+    simulate(&level, 1, on);
+
+    // Starting again halfway through a period leaves it alone
+    frc1.handler(NULL);
+    GPIO.OUT_SET = GPIO.OUT_CLEAR = 0;
+    PWMSchedule running = pwmInfo._schedules[pwmInfo._active];
+    uint8_t step = pwmInfo._step;
+
+    pwmInfo.pins[0].dutyCycle = UINT16_MAX / 2;
+    pwm_start();
+
+    CHECK(!memcmp(&running, &pwmInfo._schedules[pwmInfo._active], sizeof(running)));
+    CHECK(pwmInfo._step == step);
+    CHECK(GPIO.OUT_SET == 0 && GPIO.OUT_CLEAR == 0);
+    CHECK(pwmInfo._pending);
+
+    pwm_stop();
+}
+
+static void test_min_duty(bool dither, uint32_t periods) {
+    const uint8_t pins[] = { 4, 5 };
+    uint32_t level = 0;
+    uint64_t on[2];
+
+    pwm_init(2, pins, false);
+    CHECK(pwm_get_min_duty() == 0);
+    pwm_set_freq(1000);
+    CHECK(pwm_set_dither(dither) == 0);
+    pwm_start();
+
+    // The smallest duty from either end still pulses over a pattern
+    uint16_t min_duty = pwm_get_min_duty();
+    pwm_set_channel_duty(0, min_duty);
+    pwm_set_channel_duty(1, UINT16_MAX - min_duty);
+    simulate(&level, 1, on);
+    simulate(&level, periods, on);
+
+    CHECK(on[0] > 0);
+    CHECK(on[1] < (uint64_t)periods * pwmInfo._maxLoad);
+
+    pwm_stop();
+    printf("  %s min duty %u at 1000 Hz\n", dither ? "dithered" : "plain", min_duty);
+}
+
+// A pattern of 1 period can't dither, asking for it fails
+static void test_set_dither() {
+    const uint8_t pins[] = { 4 };
+
+    pwm_init(1, pins, false);
+    CHECK(pwm_set_dither(false) == 0);
+    CHECK(pwm_set_dither(true) == (PWM_DITHER_PERIODS > 1 ? 0 : -1));
+    CHECK(pwmInfo.dither == (PWM_DITHER_PERIODS > 1));
+    pwm_set_dither(false);
+}
+
+int main() {
+    test_init();
+    test_build_edges();
+    test_start_running();
+    test_output(false, 1, PWM_MIN_LOAD - 1);
+    test_set_dither();
+    test_min_duty(false, 1);
+#if PWM_DITHER_PERIODS > 1
+    // Skipped short pulses leave up to half a minimum pulse of carry
+    test_output(true, PWM_DITHER_PERIODS, PWM_MIN_LOAD / 2 + 1);
+    test_min_duty(true, PWM_DITHER_PERIODS);
+#endif
+
+    return test_result();
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Host stand-in
+#ifndef BIT
+#define BIT(x) (1u << (x))
+#endif
+
+#define IRAM
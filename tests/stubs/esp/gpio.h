@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <common_macros.h>
+
+// Host stand-in for GPIO registers. Tests set input levels in GPIO.IN
+// and RTC.GPIO_IN, output writes are kept for the test to apply.
+
+static struct {
+    uint32_t OUT;
+    uint32_t OUT_SET;
+    uint32_t OUT_CLEAR;
+    uint32_t IN;
+} GPIO;
+
+static struct {
+    uint32_t GPIO_IN;
+} RTC;
+
+typedef enum {
+    GPIO_INPUT,
+    GPIO_OUTPUT,
+} gpio_direction_t;
+
+typedef enum {
+    GPIO_INTTYPE_NONE = 0,
+    GPIO_INTTYPE_EDGE_POS = 1,
+    GPIO_INTTYPE_EDGE_NEG = 2,
+    GPIO_INTTYPE_EDGE_ANY = 3,
+    GPIO_INTTYPE_LEVEL_LOW = 4,
+    GPIO_INTTYPE_LEVEL_HIGH = 5,
+} gpio_inttype_t;
+
+typedef void (*gpio_interrupt_handler_t)(uint8_t gpio_num);
+
+// Interrupt handler set for each GPIO, the test calls them for edges
+static gpio_interrupt_handler_t gpio_interrupt_handlers[16];
+
+static inline void gpio_enable(uint8_t gpio_num, gpio_direction_t direction) {}
+
+static inline void gpio_set_pullup(uint8_t gpio_num, bool enabled, bool enabled_during_sleep) {}
+
+static inline void gpio_set_interrupt(uint8_t gpio_num, gpio_inttype_t type,
+                                      gpio_interrupt_handler_t handler) {
+    gpio_interrupt_handlers[gpio_num] = (type != GPIO_INTTYPE_NONE) ? handler : 0;
+}
+
+static inline bool gpio_read(uint8_t gpio_num) {
+    return (gpio_num < 16) ? (GPIO.IN >> gpio_num) & 1 : RTC.GPIO_IN & 1;
+}
+
+static inline void gpio_write(uint8_t gpio_num, bool set) {
+    if (set)
+        GPIO.OUT |= BIT(gpio_num);
+    else
+        GPIO.OUT &= ~BIT(gpio_num);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in, a fixed xorshift sequence so runs are repeatable
+static uint32_t hwrand_state = 2463534242u;
+
+static inline uint32_t hwrand() {
+    hwrand_state ^= hwrand_state << 13;
+    hwrand_state ^= hwrand_state >> 17;
+    hwrand_state ^= hwrand_state << 5;
+    return hwrand_state;
+}
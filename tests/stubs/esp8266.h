@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <esp/gpio.h>
+
+// Host stand-in for the FRC1 timer parts of the SDK, the timer only
+// records its state.
+
+typedef enum {
+    FRC1,
+} timer_frc_t;
+
+#define TIMER_CLKDIV_16 4
+#define INUM_TIMER_FRC1 9
+
+static struct {
+    uint32_t load;
+    bool run;
+    bool interrupts;
+    void (*handler)(void *arg);
+} frc1;
+
+static inline void timer_set_divider(timer_frc_t frc, int divider) {}
+static inline void timer_set_reload(timer_frc_t frc, bool reload) {}
+static inline void timer_set_load(timer_frc_t frc, uint32_t load) { frc1.load = load; }
+static inline void timer_set_run(timer_frc_t frc, bool run) { frc1.run = run; }
+static inline void timer_set_interrupts(timer_frc_t frc, bool enable) { frc1.interrupts = enable; }
+
+static inline void _xt_isr_attach(uint8_t inum, void (*handler)(void *), void *arg) {
+    frc1.handler = handler;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <FreeRTOS.h>
+
+// Host stand-in, a test defines the functions the code under test uses
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint16_t stack_depth,
+                       void *parameters, UBaseType_t priority, TaskHandle_t *task);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+#define portEND_SWITCHING_ISR(woken) ((void)(woken))
+
+// Tests run on one thread, nothing to lock out
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
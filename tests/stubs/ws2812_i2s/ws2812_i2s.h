@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in of the esp-open-rtos ws2812_i2s interface
+
+typedef union {
+    struct {
+        uint8_t blue;
+        uint8_t green;
+        uint8_t red;
+        uint8_t white;
+    };
+    uint32_t color;
+} ws2812_pixel_t;
+
+typedef enum {
+    PIXEL_RGB = 12,
+    PIXEL_RGBW = 16
+} pixeltype_t;
+
+void ws2812_i2s_init(uint32_t pixels_number, pixeltype_t type);
+void ws2812_i2s_update(ws2812_pixel_t *pixels, pixeltype_t type);
@@ -0,0 +1,4 @@
+#pragma once
+
+// Host stand-in, cycle counts read as 0
+#define RSR(var, reg) do { (var) = 0; } while (0)
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdio.h>
+
+/**
+    Minimal checks for the host tests, a failed check is printed and makes
+    test_result() return non-zero.
+*/
+
+static int test_failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        if (test_failures++ < 10) \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+} while (0)
+
+static inline int test_result() {
+    if (test_failures)
+        printf("%d checks failed\n", test_failures);
+    return test_failures != 0;
+}
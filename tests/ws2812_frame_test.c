@@ -0,0 +1,177 @@
+// Host test of WS2812 temporal dithering and frame skipping.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ws2812_frame.h>
+#include "test.h"
+
+#define COUNT 16
+#define FRAMES 256
+
+static int updates = 0;
+
+void ws2812_i2s_update(ws2812_pixel_t *pixels, pixeltype_t type) {
+    updates++;
+}
+
+
+// Over 256 frames every channel shows its 16 bit value to 1/256 of an
+// 8 bit step, up to where the sum saturates at 0xffff
+static void test_dither_average() {
+    ws2812_dither_t dither;
+    ws2812_pixel_t pixels[COUNT];
+    int error = 0;
+
+    CHECK(ws2812_dither_init(&dither, COUNT) == 0);
+    CHECK(ws2812_dither_ram(&dither) == sizeof(dither) + COUNT * 3);
+
+    for (uint32_t value = 0; value <= 0xffff; value += 17) {
+        ws2812_color16_t color = { value, value, value };
+        uint32_t sum[COUNT * 3] = { 0 };
+
+        for (int frame = 0; frame < FRAMES; frame++) {
+            ws2812_dither_fill(&dither, color, pixels);
+            for (int i = 0; i < COUNT; i++) {
+                sum[i * 3] += pixels[i].red;
+                sum[i * 3 + 1] += pixels[i].green;
+                sum[i * 3 + 2] += pixels[i].blue;
+                CHECK(pixels[i].white == 0);
+            }
+        }
+
+        for (int i = 0; i < COUNT * 3; i++) {
+            int expected = value > 0xff00 ? 255 * FRAMES : value;
+            int diff = (int)sum[i] - expected;
+            if (diff < 0)
+                diff = -diff;
+            if (diff > error)
+                error = diff;
+        }
+
+        CHECK(dither.pending == ((value & 0xff) != 0));
+    }
+
+    printf("  dither: max error of 256 frame sums %d\n", error);
+    CHECK(error <= 1);
+
+    ws2812_dither_done(&dither);
+}
+
+
+// A static color repeats its frames after a full cycle, once channels
+// saturating at 0xffff have clamped their residuals. The settled
+// color shows without dithering and the output stage then skips it
+static void test_dither_settle() {
+    ws2812_dither_t dither;
+    ws2812_output_t output;
+    ws2812_pixel_t first[COUNT], pixels[COUNT];
+    uint8_t residual[COUNT * 3];
+
+    CHECK(ws2812_dither_init(&dither, COUNT) == 0);
+    ws2812_output_init(&output, COUNT, PIXEL_RGB);
+
+    for (uint32_t value = 0; value <= 0xffff; value += 37) {
+        ws2812_color16_t color = { value, 0xffff - value, value / 3 };
+
+        for (int frame = 0; frame < WS2812_DITHER_CYCLE; frame++)
+            ws2812_dither_fill(&dither, color, pixels);
+        memcpy(residual, dither.residual, sizeof(residual));
+        ws2812_dither_fill(&dither, color, first);
+        for (int frame = 1; frame < WS2812_DITHER_CYCLE; frame++)
+            ws2812_dither_fill(&dither, color, pixels);
+        CHECK(!memcmp(residual, dither.residual, sizeof(residual)));
+
+        ws2812_dither_fill(&dither, color, pixels);
+        CHECK(!memcmp(first, pixels, sizeof(pixels)));
+
+        ws2812_color16_t rounded = ws2812_color16_round(color);
+        CHECK((rounded.red | rounded.green | rounded.blue) % 256 == 0);
+        CHECK(abs((int)rounded.red - (int)color.red) <= 0xff);
+        CHECK(abs((int)rounded.red - (int)color.red) <= 0x80 || color.red > 0xff80);
+        CHECK(rounded.red >> 8 == (color.red + 0x80 > 0xffff ? 255 : (color.red + 0x80) >> 8));
+
+        ws2812_dither_fill(&dither, rounded, pixels);
+        CHECK(!dither.pending);
+        ws2812_output_update(&output, pixels);
+        ws2812_dither_fill(&dither, rounded, pixels);
+        CHECK(!ws2812_output_update(&output, pixels));
+    }
+
+    ws2812_dither_done(&dither);
+}
+
+
+static double now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+
+// Host time and RAM of one dithered frame, the ESP8266 reports its own
+// cycles in frame_cycles
+static void benchmark_dither(size_t count) {
+    ws2812_dither_t dither;
+    ws2812_color16_t *colors = malloc(count * sizeof(*colors));
+    ws2812_pixel_t *pixels = malloc(count * sizeof(*pixels));
+    const int frames = 20000000 / count;
+
+    CHECK(ws2812_dither_init(&dither, count) == 0);
+    for (size_t i = 0; i < count; i++) {
+        colors[i].red = i * 97;
+        colors[i].green = i * 331;
+        colors[i].blue = i * 7919;
+    }
+
+    double start = now_ns();
+    for (int frame = 0; frame < frames; frame++)
+        ws2812_dither_frame(&dither, colors, pixels);
+    double frame_ns = (now_ns() - start) / frames;
+
+    printf("  dither %4zu leds: %5zu bytes, %.0f ns per frame\n",
+           count, ws2812_dither_ram(&dither), frame_ns);
+
+    ws2812_dither_done(&dither);
+    free(colors);
+    free(pixels);
+}
+
+
+static void test_output_skip() {
+    ws2812_output_t output;
+    ws2812_pixel_t pixels[COUNT] = { 0 };
+
+    ws2812_output_init(&output, COUNT, PIXEL_RGB);
+    updates = 0;
+
+    CHECK(ws2812_output_update(&output, pixels));
+    CHECK(!ws2812_output_update(&output, pixels));
+
+    // White isn't sent to RGB strips
+    pixels[3].white = 10;
+    CHECK(!ws2812_output_update(&output, pixels));
+
+    pixels[3].red = 1;
+    CHECK(ws2812_output_update(&output, pixels));
+
+    ws2812_output_invalidate(&output);
+    CHECK(ws2812_output_update(&output, pixels));
+
+    CHECK(updates == 3);
+    CHECK(output.frames_sent == 3 && output.frames_skipped == 2);
+}
+
+
+int main() {
+    test_dither_average();
+    test_dither_settle();
+    test_output_skip();
+    benchmark_dither(16);
+    benchmark_dither(60);
+    benchmark_dither(300);
+    benchmark_dither(1000);
+
+    return test_result();
+}